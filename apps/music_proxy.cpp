@@ -18,13 +18,19 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <monsteer/histogram.h>
+#include <monsteer/steering/ensemble.h>
+#include <monsteer/steering/musicMessage.h>
 #include <monsteer/steering/playbackState.h>
+#include <monsteer/steering/reply.h>
 #include <monsteer/steering/stimulus.h>
+#include <monsteer/steering/telemetry.h>
 #include <monsteer/types.h>
 
 #include <brion/spikeReport.h>
 #include <lunchbox/debug.h>
 #include <lunchbox/log.h>
+#include <lunchbox/memoryMap.h>
 
 #include <zeroeq/zeroeq.h>
 
@@ -34,19 +40,209 @@
 #include <boost/program_options.hpp>
 #include <boost/scoped_ptr.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+
 namespace po = boost::program_options;
 
 namespace
 {
 const double defaultMusicTimestep = 0.0001;
+const double defaultTelemetryInterval = 1.0;
 const brion::URI pluginURI(MONSTEER_BRION_SPIKES_PLUGIN_SCHEME + "://");
+
+// Fraction of the steering latency target that is spent waiting for the
+// next proxy tick. The rest is split between the MUSIC delivery and the
+// simulation step of the NEST script (see Nesteer target_latency).
+const double tickLatencyFraction = 0.25;
+
+double _wallTime()
+{
+    using namespace std::chrono;
+    return duration<double>(system_clock::now().time_since_epoch()).count();
 }
 
+typedef std::chrono::steady_clock Clock;
+
+uint64_t _microsecondsSince(const Clock::time_point& start)
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(Clock::now() - start).count();
+}
+}
+
+/**
+ * Transformation applied to the spikes before publishing them:
+ * - GID remapping with a table of uint32 (host byte order) memory-mapped from
+ *   a file, where entry i is the GID published for MUSIC index i. Indices
+ *   beyond the table are published unchanged.
+ * - Subset selection with a text file of GIDs and first-last GID ranges.
+ * - Bernoulli downsampling, with a global probability and per population
+ *   probabilities read from a text file with "first last probability" lines.
+ * Selection and downsampling are applied on the remapped GIDs.
+ */
+class SpikeFilter
+{
+public:
+    SpikeFilter(const std::string& gidMapFile, const std::string& subsetFile,
+                const double samplingRate, const std::string& populationsFile,
+                const uint32_t seed)
+        : _gids(nullptr)
+        , _gidCount(0)
+        , _threshold(_toThreshold(samplingRate))
+        , _random(seed)
+    {
+        if (!gidMapFile.empty())
+        {
+            _gidMap.reset(new lunchbox::MemoryMap(gidMapFile));
+            _gids = _gidMap->getAddress<uint32_t>();
+            if (!_gids)
+                _fail("Cannot map GID table " + gidMapFile);
+            _gidCount = _gidMap->getSize() / sizeof(uint32_t);
+        }
+
+        if (!subsetFile.empty())
+            _readSubset(subsetFile);
+        if (!populationsFile.empty())
+            _readPopulations(populationsFile);
+
+        _enabled = _gids || !_subset.empty() || !_populations.empty() ||
+                   _threshold < keepAll;
+    }
+
+    /** @return false if the spike is dropped, otherwise the published GID. */
+    bool apply(uint32_t& gid)
+    {
+        if (!_enabled)
+            return true;
+
+        if (gid < _gidCount)
+            gid = _gids[gid];
+
+        if (!_subset.empty() && (gid >= _subset.size() || !_subset[gid]))
+            return false;
+
+        uint64_t threshold = _threshold;
+        if (!_populations.empty())
+        {
+            auto i = std::upper_bound(_populations.begin(), _populations.end(),
+                                      gid,
+                                      [](const uint32_t value,
+                                         const Population& population) {
+                                          return value < population.first;
+                                      });
+            if (i != _populations.begin() && gid <= (--i)->last)
+                threshold = i->threshold;
+        }
+        return threshold >= keepAll || _random() < threshold;
+    }
+
+private:
+    struct Population
+    {
+        uint32_t first;
+        uint32_t last;
+        uint64_t threshold;
+    };
+
+    static const uint64_t keepAll = uint64_t(1) << 32;
+
+    std::unique_ptr<lunchbox::MemoryMap> _gidMap;
+    const uint32_t* _gids;
+    size_t _gidCount;
+    std::vector<bool> _subset;
+    std::vector<Population> _populations;
+    const uint64_t _threshold;
+    std::mt19937 _random;
+    bool _enabled;
+
+    static uint64_t _toThreshold(const double probability)
+    {
+        if (probability < 0 || probability > 1)
+            _fail("Sampling probabilities must be in [0, 1]");
+        return uint64_t(probability * double(keepAll));
+    }
+
+    static void _fail(const std::string& message)
+    {
+        LBERROR << message << std::endl;
+        ::exit(EXIT_FAILURE);
+    }
+
+    void _readSubset(const std::string& filename)
+    {
+        std::ifstream file(filename);
+        if (!file)
+            _fail("Cannot open GID subset file " + filename);
+
+        std::string token;
+        while (file >> token)
+        {
+            unsigned int first = 0, last = 0;
+            const int fields = sscanf(token.c_str(), "%u-%u", &first, &last);
+            if (fields < 1)
+                _fail("Invalid GID " + token + " in " + filename);
+            if (fields == 1)
+                last = first;
+            if (first > last)
+                _fail("Invalid GID range " + token + " in " + filename);
+
+            if (last >= _subset.size())
+                _subset.resize(size_t(last) + 1, false);
+            for (size_t gid = first; gid <= last; ++gid)
+                _subset[gid] = true;
+        }
+    }
+
+    void _readPopulations(const std::string& filename)
+    {
+        std::ifstream file(filename);
+        if (!file)
+            _fail("Cannot open population sampling file " + filename);
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            Population population;
+            double probability;
+            std::istringstream fields(line);
+            if (!(fields >> population.first >> population.last >>
+                  probability))
+            {
+                _fail("Invalid population sampling line: " + line);
+            }
+            if (population.first > population.last)
+                _fail("Invalid GID range in population sampling line: " +
+                      line);
+            population.threshold = _toThreshold(probability);
+            _populations.push_back(population);
+        }
+
+        std::sort(_populations.begin(), _populations.end(),
+                  [](const Population& a, const Population& b) {
+                      return a.first < b.first;
+                  });
+    }
+};
+
 class SpikesHandler : public MUSIC::EventHandlerGlobalIndex
 {
 public:
-    SpikesHandler(MUSIC::Setup* setup, const std::string& spikesPort)
+    SpikesHandler(MUSIC::Setup* setup, const std::string& spikesPort,
+                  SpikeFilter& filter)
         : _spikeReport(pluginURI, brion::MODE_OVERWRITE)
+        , _filter(filter)
     {
         LBINFO << "Initializing Spikes Handler" << std::endl;
 
@@ -77,18 +273,26 @@ public:
         LBINFO << "Initialized Spikes Handler" << std::endl;
     }
 
-    void operator()(double time, MUSIC::GlobalIndex gid) final
+    void operator()(double time, MUSIC::GlobalIndex index) final
     {
-        _spikeBuffer.push_back({float(time * 1000), uint32_t(gid)});
+        uint32_t gid = uint32_t(index);
+        if (_filter.apply(gid))
+            _spikeBuffer.push_back({float(time * 1000), gid});
     }
 
-    void flush()
+    /** @return the number of cells of the simulation. */
+    uint32_t getCellCount() const { return _inSpikes->width(); }
+
+    /** @return the number of spikes published. */
+    size_t flush()
     {
-        if (_spikeBuffer.empty())
-            return;
+        const size_t count = _spikeBuffer.size();
+        if (count == 0)
+            return 0;
 
         _spikeReport.write(_spikeBuffer);
         _spikeBuffer.clear();
+        return count;
     }
 
 private:
@@ -96,6 +300,7 @@ private:
     brion::SpikeReport _spikeReport;
     brion::Spikes _spikeBuffer;
     boost::scoped_ptr<MUSIC::IndexMap> _spikesMap;
+    SpikeFilter& _filter;
 };
 
 class CommandLineOptions
@@ -104,13 +309,28 @@ public:
     std::string spikesPort;
     std::string steeringPort;
 
+    std::string gidMapFile;
+    std::string gidSubsetFile;
+    std::string populationSamplingFile;
+
     bool enableSteering;
+    uint32_t simulationIndex;
 
     double musicTimestep;
+    double steeringLatency;
+    double telemetryInterval;
+
+    double samplingRate;
+    uint32_t samplingSeed;
 
     CommandLineOptions(int32_t argc, char* argv[])
         : enableSteering(false)
+        , simulationIndex(0)
         , musicTimestep(defaultMusicTimestep)
+        , steeringLatency(0)
+        , telemetryInterval(defaultTelemetryInterval)
+        , samplingRate(1)
+        , samplingSeed(0)
     {
         bool showHelp;
 
@@ -133,7 +353,33 @@ public:
              "MUSIC steering port")
             ("steering", po::bool_switch(&enableSteering)->default_value(false),
              "Enable steering. This creates the ZeroEQ subscriber and "
-             "announces the MUSIC message ports");
+             "announces the MUSIC message ports")
+            ("simulation-index",
+             po::value<uint32_t>(&simulationIndex)->default_value(0),
+             "Index of the simulation in a steering ensemble, see the "
+             "ensemble mode of the NEST simulator plugin")
+            ("steering-latency",
+             po::value<double>(&steeringLatency)->default_value(0),
+             "Target steering latency in simulation ms. Unless --timestep "
+             "is given, selects the largest tick time step that meets it. "
+             "Use the same target in Nesteer.")
+            ("telemetry-interval",
+             po::value<double>(&telemetryInterval)->default_value(
+                 defaultTelemetryInterval),
+             "Period in sec. of the ZeroEQ telemetry events, 0 to disable")
+            ("gid-map", po::value<std::string>(&gidMapFile),
+             "Binary file of uint32 with the GID to publish for each MUSIC "
+             "spike channel")
+            ("gid-subset", po::value<std::string>(&gidSubsetFile),
+             "Text file with the GIDs and first-last GID ranges to publish")
+            ("sampling-rate", po::value<double>(&samplingRate),
+             "Probability of publishing each spike")
+            ("population-sampling",
+             po::value<std::string>(&populationSamplingFile),
+             "Text file with 'first last probability' lines giving the "
+             "spike publication probability of GID ranges")
+            ("sampling-seed", po::value<uint32_t>(&samplingSeed),
+             "Seed of the spike downsampling random number generator");
         // clang-format on
 
         options.add_options();
@@ -162,14 +408,20 @@ public:
             std::cout << options << std::endl;
             ::exit(EXIT_SUCCESS);
         }
+
+        if (steeringLatency > 0 && variableMap["timestep"].defaulted())
+            musicTimestep = steeringLatency * tickLatencyFraction / 1000.0;
     }
 };
 
 class SteeringHandler
 {
 public:
-    SteeringHandler(MUSIC::Setup* setup, const std::string& steeringPort)
+    SteeringHandler(MUSIC::Setup* setup, const std::string& steeringPort,
+                    const uint32_t cellCount, const uint32_t simulationIndex)
         : _state(monsteer::steering::State::PLAY)
+        , _cellCount(cellCount)
+        , _simulationIndex(simulationIndex)
     {
         LBINFO << "Initializing Steering Handler" << std::endl;
 
@@ -183,65 +435,513 @@ public:
 
         _steeringOutput->map();
 
+        using monsteer::steering::EnsembleRequest;
+        using monsteer::steering::InjectionBatch;
         using monsteer::steering::PlaybackState;
         using monsteer::steering::StimulusInjection;
+        using monsteer::steering::StimulusInjectionV2;
+        using monsteer::steering::StimulusUpdate;
+        using monsteer::steering::StatusRequest;
+        using monsteer::steering::TemplateRegistration;
 
-        _subscriber.subscribe(PlaybackState::ZEROBUF_TYPE_IDENTIFIER(),
-                              [&](const void* data, const size_t size) {
-                                  _onPlaybackStateChange(
-                                      PlaybackState::create(data, size));
-                              });
-        _subscriber.subscribe(StimulusInjection::ZEROBUF_TYPE_IDENTIFIER(),
+        _subscribe(PlaybackState::ZEROBUF_TYPE_IDENTIFIER(),
+                   [&](const void* data, const size_t size) {
+                       _onPlaybackStateChange(
+                           PlaybackState::create(data, size));
+                   });
+        _subscribe(StimulusInjection::ZEROBUF_TYPE_IDENTIFIER(),
+                   [&](const void* data, const size_t size) {
+                       _onStimulusInjection(
+                           StimulusInjection::create(data, size));
+                   });
+        _subscribe(StimulusInjectionV2::ZEROBUF_TYPE_IDENTIFIER(),
+                   [&](const void* data, const size_t size) {
+                       _onStimulusInjection(
+                           StimulusInjectionV2::create(data, size));
+                   });
+        _subscribe(StimulusUpdate::ZEROBUF_TYPE_IDENTIFIER(),
+                   [&](const void* data, const size_t size) {
+                       _onStimulusUpdate(StimulusUpdate::create(data, size));
+                   });
+        _subscribe(StatusRequest::ZEROBUF_TYPE_IDENTIFIER(),
+                   [&](const void* data, const size_t size) {
+                       _statusRequests.push_back(
+                           StatusRequest::create(data, size)->getMessageID());
+                   });
+        _subscribe(InjectionBatch::ZEROBUF_TYPE_IDENTIFIER(),
+                   [&](const void* data, const size_t size) {
+                       _onInjectionBatch(InjectionBatch::create(data, size));
+                   });
+        _subscribe(TemplateRegistration::ZEROBUF_TYPE_IDENTIFIER(),
+                   [&](const void* data, const size_t size) {
+                       _onTemplateRegistration(
+                           TemplateRegistration::create(data, size));
+                   });
+        _subscriber.subscribe(EnsembleRequest::ZEROBUF_TYPE_IDENTIFIER(),
                               [&](const void* data, const size_t size) {
-                                  _onStimulusInjection(
-                                      StimulusInjection::create(data, size));
+                                  _onEnsembleRequest(
+                                      EnsembleRequest::create(data, size));
                               });
 
         LBINFO << "Initialized Steering Handler" << std::endl;
     }
 
-    void processMessages(const double musicTime)
+    /**
+     * Update the playback state before a tick.
+     * @return true if the MUSIC runtime has to be advanced one tick.
+     */
+    bool startTick()
     {
+        using monsteer::steering::State;
         switch (_state)
         {
-        case monsteer::steering::State::PLAY:
-        {
-            _currentTime = musicTime;
-            while (_subscriber.receive(0))
-                ;
-            break;
+        case State::PLAY:
+        case State::RUN_UNTIL:
+            return true;
+        case State::STEP:
+            if (--_remainingSteps == 0)
+                _state = State::PAUSE;
+            return true;
+        case State::PAUSE:
+        default:
+            return false;
         }
-        case monsteer::steering::State::PAUSE:
+    }
+
+    /**
+     * Receive the steering events and forward them to the simulation.
+     * Blocks until an event is received if the simulation is paused.
+     * @return the number of ZeroEQ events processed.
+     */
+    size_t processMessages(const double musicTime)
+    {
+        using monsteer::steering::State;
+        _currentTime = musicTime;
+        if (_state == State::RUN_UNTIL && musicTime >= _untilTime)
+            _state = State::PAUSE;
+
+        size_t count = 0;
+        if (_state == State::PAUSE)
         {
-            _subscriber.receive(-1);
-            break;
+            if (_subscriber.receive(-1))
+                ++count;
         }
+        else
+        {
+            while (_subscriber.receive(0))
+                ++count;
         }
+        _flush();
+        _acknowledge();
+        _replyStatus();
+        return count;
     }
 
     monsteer::steering::State getPlaybackState() const { return _state; }
+    void logStatistics() const
+    {
+        if (_forwardedMessages == 0)
+            return;
+
+        LBINFO << "Forwarded " << _forwardedMessages
+               << " steering messages, proxy delay avg "
+               << _totalDelay / _forwardedMessages * 1000.0 << " ms, max "
+               << _maxDelay * 1000.0 << " ms" << std::endl;
+    }
+
 private:
+    // The handlers are also used for the events wrapped in ensemble requests.
+    void _subscribe(const servus::uint128_t& type,
+                    const zeroeq::EventPayloadFunc& handler)
+    {
+        _subscriber.subscribe(type, handler);
+        _handlers[type] = handler;
+    }
+
+    void _onEnsembleRequest(monsteer::steering::ConstEnsembleRequestPtr event)
+    {
+        const uint32_t simulation = event->getSimulation();
+        if (simulation != _simulationIndex &&
+            simulation != std::numeric_limits<uint32_t>::max())
+        {
+            return;
+        }
+
+        const servus::uint128_t type(event->getTypeHigh(),
+                                     event->getTypeLow());
+        const auto i = _handlers.find(type);
+        if (i == _handlers.end())
+        {
+            LBWARN << "Dropping ensemble request of unknown type " << type
+                   << std::endl;
+            return;
+        }
+        const auto& data = event->getEvent();
+        i->second(data.data(), data.size());
+    }
+
     void _onStimulusInjection(
         monsteer::steering::ConstStimulusInjectionPtr event)
     {
-        const std::string& json = event->toJSON();
-        // Although music library internally "does not" touch the sent data,
-        // the Music "insertMessage" function accepts only non-const data.
-        // Not to have a second copy, the below const_cast is applied.
-        _steeringOutput->insertMessage(_currentTime,
-                                       const_cast<char*>(json.c_str()),
-                                       json.size());
+        if (_message.empty())
+            _receiveTime = _wallTime();
+
+        const auto& cells = event->getCells();
+        _message.addStimulusInjection(event->getParamsString(), cells.data(),
+                                      cells.size(), event->getMultiple());
+        ++_anonymousStimuli;
+    }
+
+    void _onStimulusInjection(
+        monsteer::steering::ConstStimulusInjectionV2Ptr event)
+    {
+        if (_message.empty())
+            _receiveTime = _wallTime();
+
+        // The cells are forwarded in the encoding chosen by the client.
+        monsteer::steering::CompactStimulusInjectionRecord record;
+        record.messageID = event->getMessageID();
+        record.templateID = event->getTemplateID();
+        record.model = event->getModelString();
+        record.parameterNames = event->getParameterNamesString();
+        record.parameterValues = event->getParameterValuesVector();
+        record.jsonParameters = event->getJsonParametersString();
+        record.time = event->getTime();
+        record.multiple = event->getMultiple();
+        record.cellEncoding = event->getCellEncoding();
+        const auto& cells = event->getCells();
+        record.cells = cells.data();
+        record.cellWords = cells.size();
+        _message.addStimulusInjection(record);
+
+        if (record.messageID != 0)
+        {
+            _stimuli.insert(record.messageID);
+            _addAcknowledgement(record.messageID, record.time);
+        }
+    }
+
+    void _onTemplateRegistration(
+        monsteer::steering::ConstTemplateRegistrationPtr event)
+    {
+        if (_message.empty())
+            _receiveTime = _wallTime();
+
+        monsteer::steering::StimulusTemplateRecord record;
+        record.templateID = event->getMessageID();
+        record.model = event->getModelString();
+        record.parameterNames = event->getParameterNamesString();
+        record.parameterValues = event->getParameterValuesVector();
+        record.jsonParameters = event->getJsonParametersString();
+        _message.addStimulusTemplate(record);
+        _acknowledged.push_back(record.templateID);
+    }
+
+    // All the injections received in a tick are forwarded together in a
+    // single message, so the simulator only decodes one payload per step.
+    void _flush()
+    {
+        if (_message.empty())
+            return;
+
+        // The timing record lets the simulation side measure the end-to-end
+        // latency of the requests.
+        const double sendTime = _wallTime();
+        _message.addTiming(_receiveTime, sendTime, _currentTime * 1000.0);
+
+        ++_forwardedMessages;
+        _totalDelay += sendTime - _receiveTime;
+        _maxDelay = std::max(_maxDelay, sendTime - _receiveTime);
+
+        std::string text = _message.toBase64();
+        _message.clear();
+        // The MUSIC "insertMessage" function accepts only non-const data,
+        // although it does not modify it.
+        _steeringOutput->insertMessage(_currentTime, &text[0], text.size());
+    }
+
+    void _onStimulusUpdate(monsteer::steering::ConstStimulusUpdatePtr event)
+    {
+        if (_message.empty())
+            _receiveTime = _wallTime();
+
+        if (event->getRemove())
+        {
+            _message.addStimulusRemoval(event->getStimulusID());
+            _stimuli.erase(event->getStimulusID());
+        }
+        else
+        {
+            monsteer::steering::StimulusUpdateRecord record;
+            record.stimulusID = event->getStimulusID();
+            record.parameterNames = event->getParameterNamesString();
+            record.parameterValues = event->getParameterValuesVector();
+            record.jsonParameters = event->getJsonParametersString();
+            _message.addStimulusUpdate(record);
+        }
+
+        if (event->getMessageID() != 0)
+            _acknowledged.push_back(event->getMessageID());
+    }
+
+    // The records of a batch are spliced into the message of the current
+    // tick, so they reach the simulation together. All the records are
+    // parsed first, a malformed batch is dropped as a whole.
+    void _onInjectionBatch(monsteer::steering::ConstInjectionBatchPtr event)
+    {
+        using monsteer::steering::MusicMessageRecord;
+        const auto& records = event->getRecords();
+        // The stimuli of the batch, tracked as those of single requests
+        std::vector<BatchStimulus> stimuli;
+        try
+        {
+            stimuli = _parseBatch(records.data(), records.size());
+            if (_message.empty())
+                _receiveTime = _wallTime();
+            _message.addRecords(records.data(), records.size());
+        }
+        catch (const std::runtime_error& error)
+        {
+            LBWARN << "Dropping stimulus batch: " << error.what() << std::endl;
+            return;
+        }
+
+        // The batch takes effect when its last scheduled injection starts.
+        double onset = 0;
+        for (const BatchStimulus& stimulus : stimuli)
+        {
+            if (stimulus.type == MusicMessageRecord::stimulusRemoval)
+                _stimuli.erase(stimulus.id);
+            else if (stimulus.id != 0)
+                _stimuli.insert(stimulus.id);
+            else
+                ++_anonymousStimuli;
+            onset = std::max(onset, stimulus.time);
+        }
+        _addAcknowledgement(event->getMessageID(), onset);
+    }
+
+    struct BatchStimulus
+    {
+        monsteer::steering::MusicMessageRecord type;
+        uint64_t id; // 0 for anonymous injections
+        double time;
+    };
+
+    // @throw std::runtime_error if any record of the batch is malformed.
+    static std::vector<BatchStimulus> _parseBatch(const void* data,
+                                                  const size_t size)
+    {
+        using monsteer::steering::MusicMessageRecord;
+        std::vector<BatchStimulus> stimuli;
+        monsteer::steering::MusicMessageReader reader(data, size);
+        while (reader.next())
+        {
+            const MusicMessageRecord type = reader.getType();
+            switch (type)
+            {
+            case MusicMessageRecord::compactStimulusInjection:
+            {
+                const auto record = reader.getCompactStimulusInjection();
+                stimuli.push_back({type, record.messageID, record.time});
+                break;
+            }
+            case MusicMessageRecord::stimulusInjection:
+                reader.getStimulusInjection();
+                stimuli.push_back({type, 0, 0});
+                break;
+            case MusicMessageRecord::stimulusRemoval:
+                stimuli.push_back({type, reader.getStimulusRemoval(), 0});
+                break;
+            case MusicMessageRecord::stimulusUpdate:
+                reader.getStimulusUpdate();
+                break;
+            case MusicMessageRecord::stimulusTemplate:
+                reader.getStimulusTemplate();
+                break;
+            case MusicMessageRecord::timing:
+                reader.getTiming();
+                break;
+            default:
+                break;
+            }
+        }
+        return stimuli;
+    }
+
+    // Scheduled injections are acknowledged with their onset in ms, unless
+    // it is already past.
+    void _addAcknowledgement(const uint64_t messageID, const double onset)
+    {
+        if (messageID == 0)
+            return;
+        if (onset > _currentTime * 1000.0)
+            _scheduled[onset].push_back(messageID);
+        else
+            _acknowledged.push_back(messageID);
+    }
+
+    // Requests are acknowledged with the time at which they are inserted in
+    // the MUSIC port, scheduled injections with their onset, and playback
+    // changes with the time at which they are applied.
+    void _acknowledge()
+    {
+        if (!_acknowledged.empty())
+        {
+            _replyPublisher.publish(monsteer::steering::Acknowledgement(
+                _acknowledged, _currentTime * 1000.0));
+            _acknowledged.clear();
+        }
+        for (const auto& scheduled : _scheduled)
+        {
+            _replyPublisher.publish(monsteer::steering::Acknowledgement(
+                scheduled.second, scheduled.first));
+        }
+        _scheduled.clear();
+    }
+
+    // Status queries are answered from the state of the proxy, they never
+    // reach the simulation.
+    void _replyStatus()
+    {
+        for (const uint64_t messageID : _statusRequests)
+        {
+            _replyPublisher.publish(monsteer::steering::StatusReply(
+                messageID, _currentTime * 1000.0, _state, _cellCount,
+                uint32_t(_stimuli.size() + _anonymousStimuli)));
+        }
+        _statusRequests.clear();
     }
 
     void _onPlaybackStateChange(monsteer::steering::ConstPlaybackStatePtr event)
     {
+        using monsteer::steering::State;
+        if (event->getMessageID() != 0)
+            _acknowledged.push_back(event->getMessageID());
+
         _state = event->getState();
+        _remainingSteps = event->getSteps();
+        _untilTime = event->getTime() / 1000.0;
+
+        if ((_state == State::STEP && _remainingSteps == 0) ||
+            (_state == State::RUN_UNTIL && _currentTime >= _untilTime))
+        {
+            _state = State::PAUSE;
+        }
     }
 
     zeroeq::Subscriber _subscriber;
+    zeroeq::Publisher _replyPublisher;
     MUSIC::MessageOutputPort* _steeringOutput;
-    double _currentTime;
+    monsteer::steering::MusicMessageWriter _message;
+    std::vector<uint64_t> _acknowledged;
+    std::map<double, std::vector<uint64_t>> _scheduled; // By onset in ms
+    double _currentTime = 0;
     monsteer::steering::State _state;
+    uint32_t _remainingSteps = 0;
+    double _untilTime = 0; // In seconds
+
+    std::vector<uint64_t> _statusRequests;
+    const uint32_t _cellCount;
+    std::unordered_set<uint64_t> _stimuli; // IDs of the stimuli not removed
+    // Stimuli without ID, injected in batches or by old clients. They
+    // cannot be removed.
+    size_t _anonymousStimuli = 0;
+
+    const uint32_t _simulationIndex; // In a steering ensemble
+    std::map<servus::uint128_t, zeroeq::EventPayloadFunc> _handlers;
+
+    double _receiveTime = 0;
+    size_t _forwardedMessages = 0;
+    double _totalDelay = 0;
+    double _maxDelay = 0;
+};
+
+/** Per tick histograms, published periodically and logged at exit. */
+class Telemetry
+{
+public:
+    enum Metric
+    {
+        tickDuration,
+        flushDuration,
+        spikesPerTick,
+        publishBytes,
+        steeringMessages,
+        metricCount
+    };
+
+    explicit Telemetry(const double interval)
+        : _interval(interval)
+        , _lastPublication(_wallTime())
+    {
+        if (_interval > 0)
+            _publisher.reset(new zeroeq::Publisher);
+    }
+
+    void record(const Metric metric, const uint64_t value)
+    {
+        _current[metric].record(value);
+    }
+
+    /** Publish the telemetry event if the interval has elapsed. */
+    void update(const double simulationTime)
+    {
+        const double now = _wallTime();
+        if (now - _lastPublication < _interval)
+            return;
+
+        if (_publisher)
+        {
+            monsteer::steering::ProxyTelemetry event;
+            event.setSimulationTime(simulationTime);
+            event.setInterval(now - _lastPublication);
+            event.setTickDuration(_summarize(_current[tickDuration]));
+            event.setFlushDuration(_summarize(_current[flushDuration]));
+            event.setSpikesPerTick(_summarize(_current[spikesPerTick]));
+            event.setPublishBytes(_summarize(_current[publishBytes]));
+            event.setSteeringMessages(_summarize(_current[steeringMessages]));
+            _publisher->publish(event);
+        }
+
+        for (size_t i = 0; i != metricCount; ++i)
+        {
+            _total[i].merge(_current[i]);
+            _current[i].reset();
+        }
+        _lastPublication = now;
+    }
+
+    void log()
+    {
+        static const char* names[] = {"tick duration (us)",
+                                      "flush duration (us)", "spikes per tick",
+                                      "publish bytes per tick",
+                                      "steering messages"};
+        for (size_t i = 0; i != metricCount; ++i)
+        {
+            _total[i].merge(_current[i]);
+            _current[i].reset();
+            LBINFO << names[i] << ": " << _total[i] << std::endl;
+        }
+    }
+
+private:
+    const double _interval;
+    double _lastPublication;
+    std::unique_ptr<zeroeq::Publisher> _publisher;
+    monsteer::Histogram _current[metricCount];
+    monsteer::Histogram _total[metricCount];
+
+    static monsteer::steering::HistogramSummary _summarize(
+        const monsteer::Histogram& histogram)
+    {
+        return monsteer::steering::HistogramSummary(
+            histogram.getCount(), histogram.getMin(), histogram.getMean(),
+            histogram.getPercentile(50), histogram.getPercentile(90),
+            histogram.getPercentile(99), histogram.getPercentile(99.9),
+            histogram.getMax());
+    }
 };
 
 class Proxy : boost::noncopyable
@@ -255,12 +955,18 @@ public:
         , _communicator(_setup->communicator())
         , _rank(_communicator.Get_rank())
         , _options(argc, argv)
-        , _spikesHandler(_setup, _options.spikesPort)
+        , _spikeFilter(_options.gidMapFile, _options.gidSubsetFile,
+                       _options.samplingRate, _options.populationSamplingFile,
+                       _options.samplingSeed)
+        , _spikesHandler(_setup, _options.spikesPort, _spikeFilter)
+        , _telemetry(_options.telemetryInterval)
     {
         if (_options.enableSteering)
         {
             _steeringHandler.reset(
-                new SteeringHandler(_setup, _options.steeringPort));
+                new SteeringHandler(_setup, _options.steeringPort,
+                                    _spikesHandler.getCellCount(),
+                                    _options.simulationIndex));
         }
 
         _setup->config("stoptime", &_stoptime);
@@ -268,7 +974,8 @@ public:
 
     void run()
     {
-        LBINFO << "Starting MUSIC runtime" << std::endl;
+        LBINFO << "Starting MUSIC runtime, time step " << _options.musicTimestep
+               << " s" << std::endl;
         MUSIC::Runtime runtime(_setup, _options.musicTimestep);
         // The constructor has called delete _setup.
         _setup = 0;
@@ -278,21 +985,38 @@ public:
         double apptime = runtime.time();
         while (apptime < _stoptime)
         {
-            if (!_steeringHandler ||
-                _steeringHandler->getPlaybackState() ==
-                    monsteer::steering::State::PLAY)
+            if (!_steeringHandler || _steeringHandler->startTick())
             {
+                const auto tickStart = Clock::now();
                 runtime.tick();
+                _telemetry.record(Telemetry::tickDuration,
+                                  _microsecondsSince(tickStart));
+
+                // Flushing before processing the steering messages ensures
+                // that the spikes of the last tick before a pause are
+                // published.
+                const auto flushStart = Clock::now();
+                const size_t spikes = _spikesHandler.flush();
+                _telemetry.record(Telemetry::flushDuration,
+                                  _microsecondsSince(flushStart));
+                _telemetry.record(Telemetry::spikesPerTick, spikes);
+                _telemetry.record(Telemetry::publishBytes,
+                                  spikes * sizeof(brion::Spike));
             }
 
+            apptime = runtime.time();
             if (_steeringHandler)
-                _steeringHandler->processMessages(apptime);
+                _telemetry.record(Telemetry::steeringMessages,
+                                  _steeringHandler->processMessages(apptime));
 
-            _spikesHandler.flush();
-            apptime = runtime.time();
+            _telemetry.update(apptime * 1000.0);
         }
 
         runtime.finalize();
+
+        _telemetry.log();
+        if (_steeringHandler)
+            _steeringHandler->logStatistics();
     }
 
 private:
@@ -306,8 +1030,10 @@ private:
     double _stoptime;
 
     // Internal data structures
+    SpikeFilter _spikeFilter;
     SpikesHandler _spikesHandler;
     boost::scoped_ptr<SteeringHandler> _steeringHandler;
+    Telemetry _telemetry;
 };
 
 int32_t main(int32_t argc, char* argv[])
@@ -0,0 +1,57 @@
+#!/usr/bin/env python
+
+## Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+##
+## This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+
+# Measures the time taken by the Nesteer constructor to query the global ids
+# of the neurons and connect them to the MUSIC spike output, compared with
+# one NEST call per neuron. Requires NEST compiled with MUSIC support, it
+# does not need to be launched with music.
+#
+# Usage: nesteer_setup.py [cell_count ...]
+
+import sys
+import time
+
+import nest
+from monsteer.Nesteer import Nesteer
+
+
+def per_neuron_setup(neurons, gids):
+    """ The setup done by Nesteer with a NEST call per neuron. """
+    global_ids = [nest.GetStatus([neuron])[0]['global_id']
+                  for neuron in neurons]
+    output = nest.Create('music_event_out_proxy', 1)
+    nest.SetStatus(output, {'port_name': 'benchmark_spikes'})
+    for gid, neuron in zip(gids, global_ids):
+        nest.Connect([neuron], output, 'one_to_one', {'music_channel': gid})
+
+
+def bulk_setup(neurons, gids):
+    Nesteer('benchmark_spikes', 'benchmark_steering', neurons, gids)
+
+
+def measure(setup, cell_count):
+    nest.ResetKernel()
+    nest.set_verbosity('M_ERROR')
+    neurons = nest.Create('iaf_psc_alpha', cell_count)
+    gids = range(1, cell_count + 1)
+    start = time.time()
+    setup(neurons, gids)
+    return time.time() - start
+
+
+def main(argv):
+    counts = [int(arg) for arg in argv[1:]] or [1000, 10000, 100000]
+    print('{0:>10} {1:>12} {2:>12} {3:>8}'.format(
+        'cells', 'per neuron', 'bulk', 'speedup'))
+    for count in counts:
+        baseline = measure(per_neuron_setup, count)
+        bulk = measure(bulk_setup, count)
+        print('{0:>10} {1:>11.3f}s {2:>11.3f}s {3:>7.1f}x'.format(
+            count, baseline, bulk, baseline / bulk))
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,257 @@
+#!/usr/bin/env python
+
+## Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+##
+## This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+
+# Benchmarks of the Python layer of Monsteer:
+# - injection: stimulus injections per second sent with monsteer.Simulator,
+#   as parameter dicts, compiled StimulusParameters and injectStimuli()
+#   batches. Requests are only published, no simulation is needed.
+# - nesteer: time taken by Nesteer to apply a steering message as a function
+#   of the number of injections and cells in it. Requires NEST compiled with
+#   MUSIC support, it does not need to be launched with music.
+# - stream: spikes per second read into NumPy with monsteer.SpikeStream,
+#   from --spikes or from a generated NEST spike file.
+#
+# The results are written as JSON to --output. With --baseline, the results
+# are compared with a previous output and the exit code is 1 if any
+# benchmark is slower than --tolerance. --profile writes the cProfile
+# statistics of every benchmark to a directory, to be read with pstats.
+#
+# Usage: python_bindings.py [--output results.json] [--baseline old.json]
+#                           [benchmark ...]
+
+import argparse
+import cProfile
+import json
+import os
+import platform
+import shutil
+import sys
+import tempfile
+import time
+
+import numpy
+
+import monsteer
+
+
+def timed(function, repeat):
+    """ Returns the median of repeat wall clock times of function(). """
+    times = []
+    for i in range(repeat):
+        start = time.time()
+        function()
+        times.append(time.time() - start)
+    return float(numpy.median(times))
+
+
+class Suite(object):
+    def __init__(self, options):
+        self._options = options
+        self.results = []
+
+    def run(self, name, parameters, function, count, unit):
+        """
+        Measures function, which processes count units, and records the
+        throughput in units per second.
+        """
+        if self._options.profile:
+            profiler = cProfile.Profile()
+            profiler.runcall(function)
+            key = '_'.join([name] + ['{0}{1}'.format(k, v) for k, v in
+                                     sorted(parameters.items())])
+            profiler.dump_stats(os.path.join(self._options.profile,
+                                             key + '.pstats'))
+
+        seconds = timed(function, self._options.repeat)
+        result = {'benchmark': name, 'parameters': parameters,
+                  'seconds': seconds, 'throughput': count / seconds,
+                  'unit': unit + '/s'}
+        self.results.append(result)
+        print('{0:<10} {1:<40} {2:>10.4f}s {3:>14.1f} {4}'.format(
+            name, ' '.join('{0}={1}'.format(k, v) for k, v in
+                           sorted(parameters.items())),
+            seconds, result['throughput'], result['unit']))
+
+    def skip(self, name, reason):
+        self.results.append({'benchmark': name, 'skipped': reason})
+        print('{0:<10} skipped: {1}'.format(name, reason))
+
+
+def injection(suite, options):
+    simulator = monsteer.Simulator(options.uri)
+    params = {'model': 'poisson_generator', 'rate': 50.0, 'weight': 2.5,
+              'spike_times': [1.0, 2.0]}
+    compiled = monsteer.StimulusParameters(params)
+    count = options.injections
+
+    for cell_count in (1, 100, 10000):
+        cells = numpy.arange(cell_count, dtype=numpy.uint32)
+        parameters = {'cells': cell_count, 'injections': count}
+
+        def send_dicts():
+            for i in range(count):
+                simulator.injectStimulus(params, cells)
+
+        def send_compiled():
+            for i in range(count):
+                simulator.injectStimulus(compiled, cells)
+
+        def send_batch():
+            simulator.injectStimuli([(compiled, cells)] * count)
+
+        suite.run('inject', dict(parameters, mode='dict'), send_dicts, count,
+                  'injections')
+        suite.run('inject', dict(parameters, mode='compiled'), send_compiled,
+                  count, 'injections')
+        suite.run('inject', dict(parameters, mode='batch'), send_batch, count,
+                  'injections')
+
+
+def nesteer(suite, options):
+    try:
+        import nest
+        from monsteer.Nesteer import Nesteer
+    except ImportError as error:
+        suite.skip('nesteer', str(error))
+        return
+
+    nest.set_verbosity('M_ERROR')
+    nest.ResetKernel()
+    cell_count = 10000
+    neurons = nest.Create('iaf_psc_alpha', cell_count)
+    steering = Nesteer('benchmark_spikes', 'benchmark_steering', neurons,
+                       range(1, cell_count + 1))
+
+    # The default function prints every stimulus
+    def connect(generators, targets):
+        if len(generators) == 1:
+            nest.Connect([generators[0]], targets, 'all_to_all')
+        else:
+            nest.Connect(generators, targets, 'one_to_one')
+    steering.set_apply_generators_to_neurons_function(connect)
+    params = monsteer.StimulusParameters(
+        {'model': 'poisson_generator', 'rate': 50.0})
+
+    for injections in (1, 10, 100):
+        for cells in (10, 100, 1000):
+            gids = numpy.arange(1, cells + 1, dtype=numpy.uint32)
+            batch = monsteer.StimulusBatch()
+            batch.injectStimuli([(params, gids)] * injections)
+            message = batch.toBase64()
+            suite.run('nesteer', {'injections': injections, 'cells': cells,
+                                  'bytes': len(message)},
+                      lambda: steering.process_messages([message]),
+                      injections * cells, 'stimuli')
+
+
+def _write_spikes(path, count, cell_count):
+    """ Writes a NEST spike file with count spikes over 1 s. """
+    times = numpy.sort(numpy.random.uniform(0, 1000, count))
+    gids = numpy.random.randint(1, cell_count + 1, count)
+    numpy.savetxt(path, numpy.column_stack((gids, times)), fmt='%d\t%.3f')
+
+
+def stream(suite, options):
+    if not hasattr(monsteer, 'SpikeStream'):
+        suite.skip('stream', 'monsteer built without NumPy')
+        return
+
+    directory = None
+    uri = options.spikes
+    if not uri:
+        directory = tempfile.mkdtemp()
+        uri = os.path.join(directory, 'spikes.gdf')
+        _write_spikes(uri, options.spike_count, 100000)
+    try:
+        for window in (1.0, 10.0, 100.0):
+            def read_stream():
+                spikes = monsteer.SpikeStream(uri)
+                count = 0
+                while spikes.getState() == 'OK':
+                    end = spikes.getCurrentTime() + window
+                    count += len(spikes.readUntil(end))
+                spikes.close()
+                return count
+
+            suite.run('stream', {'window': window}, read_stream,
+                      read_stream(), 'spikes')
+    finally:
+        if directory:
+            shutil.rmtree(directory)
+
+
+BENCHMARKS = {'injection': injection, 'nesteer': nesteer, 'stream': stream}
+
+
+def compare(results, baseline, tolerance):
+    """
+    Prints the benchmarks slower than in baseline by more than tolerance
+    and returns whether there is any.
+    """
+    def key(result):
+        return (result['benchmark'],
+                json.dumps(result['parameters'], sort_keys=True))
+    previous = dict((key(result), result) for result in baseline['results']
+                    if 'skipped' not in result)
+    regressions = False
+    for result in results:
+        old = previous.get(key(result)) if 'skipped' not in result else None
+        if old is None:
+            continue
+        ratio = result['throughput'] / old['throughput']
+        if ratio < 1.0 - tolerance:
+            regressions = True
+            print('Regression: {0} {1} {2:.1f}% of the baseline'.format(
+                result['benchmark'], result['parameters'], ratio * 100))
+    return regressions
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(
+        description='Benchmarks of the Monsteer Python bindings')
+    parser.add_argument('benchmarks', nargs='*', choices=sorted(BENCHMARKS),
+                        help='benchmarks to run, all by default')
+    parser.add_argument('--output', default='monsteer_benchmarks.json',
+                        help='JSON file for the results')
+    parser.add_argument('--baseline', help='JSON results to compare with')
+    parser.add_argument('--tolerance', type=float, default=0.1,
+                        help='relative slowdown reported as regression')
+    parser.add_argument('--repeat', type=int, default=5,
+                        help='measurements per benchmark, the median is kept')
+    parser.add_argument('--profile', metavar='DIRECTORY',
+                        help='write the cProfile statistics of every '
+                             'benchmark to this directory')
+    parser.add_argument('--uri', default='nest://',
+                        help='simulator URI of the injection benchmark')
+    parser.add_argument('--injections', type=int, default=1000,
+                        help='injections per measurement')
+    parser.add_argument('--spikes',
+                        help='spike report URI of the stream benchmark')
+    parser.add_argument('--spike-count', type=int, default=1000000,
+                        help='spikes of the generated spike report')
+    options = parser.parse_args(argv[1:])
+    if options.profile and not os.path.isdir(options.profile):
+        os.makedirs(options.profile)
+
+    suite = Suite(options)
+    for name in options.benchmarks or sorted(BENCHMARKS):
+        BENCHMARKS[name](suite, options)
+
+    with open(options.output, 'w') as output:
+        json.dump({'timestamp': time.time(), 'host': platform.node(),
+                   'python': platform.python_version(),
+                   'numpy': numpy.__version__, 'repeat': options.repeat,
+                   'results': suite.results}, output, indent=2)
+
+    if options.baseline:
+        with open(options.baseline) as baseline:
+            if compare(suite.results, json.load(baseline), options.tolerance):
+                return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
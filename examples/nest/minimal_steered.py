@@ -29,8 +29,4 @@ def apply_spikes(generator, neurons):
     Connect(generator, neurons, 'all_to_all', syn_spec={'weight': 40.0})
 isc_communicator.set_apply_generators_to_neurons_function(apply_spikes)
 
-time = 0
-while time < duration:
-    Simulate(10)
-    isc_communicator.process_events()
-    time += 10
+isc_communicator.run(duration)
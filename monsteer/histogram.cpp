@@ -0,0 +1,138 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+
+namespace monsteer
+{
+namespace
+{
+const unsigned SUB_BUCKET_BITS = 7;
+const uint64_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+const uint64_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+
+unsigned _msb(uint64_t value)
+{
+    unsigned bit = 0;
+    while (value >>= 1)
+        ++bit;
+    return bit;
+}
+
+size_t _bucketIndex(const uint64_t value)
+{
+    if (value < SUB_BUCKET_COUNT)
+        return value;
+    // Keep the SUB_BUCKET_BITS most significant bits of the value.
+    const unsigned shift = _msb(value) - (SUB_BUCKET_BITS - 1);
+    const uint64_t mantissa = value >> shift;
+    return SUB_BUCKET_COUNT + (shift - 1) * SUB_BUCKET_HALF +
+           (mantissa - SUB_BUCKET_HALF);
+}
+
+uint64_t _bucketUpperBound(const size_t index)
+{
+    if (index < SUB_BUCKET_COUNT)
+        return index;
+    const size_t offset = index - SUB_BUCKET_COUNT;
+    const unsigned shift = unsigned(offset / SUB_BUCKET_HALF) + 1;
+    const uint64_t mantissa = SUB_BUCKET_HALF + offset % SUB_BUCKET_HALF;
+    return ((mantissa + 1) << shift) - 1;
+}
+}
+
+void Histogram::record(const uint64_t value, const uint64_t count)
+{
+    if (count == 0)
+        return;
+
+    const size_t index = _bucketIndex(value);
+    if (index >= _buckets.size())
+        _buckets.resize(index + 1, 0);
+    _buckets[index] += count;
+
+    _min = _count ? std::min(_min, value) : value;
+    _max = std::max(_max, value);
+    _count += count;
+    _total += double(value) * count;
+}
+
+void Histogram::merge(const Histogram& other)
+{
+    if (other._count == 0)
+        return;
+
+    if (other._buckets.size() > _buckets.size())
+        _buckets.resize(other._buckets.size(), 0);
+    for (size_t i = 0; i != other._buckets.size(); ++i)
+        _buckets[i] += other._buckets[i];
+
+    _min = _count ? std::min(_min, other._min) : other._min;
+    _max = std::max(_max, other._max);
+    _count += other._count;
+    _total += other._total;
+}
+
+void Histogram::reset()
+{
+    std::fill(_buckets.begin(), _buckets.end(), 0);
+    _count = 0;
+    _min = 0;
+    _max = 0;
+    _total = 0;
+}
+
+double Histogram::getMean() const
+{
+    return _count ? _total / _count : 0;
+}
+
+uint64_t Histogram::getPercentile(const double percentile) const
+{
+    if (_count == 0)
+        return 0;
+
+    const double clamped = std::min(std::max(percentile, 0.0), 100.0);
+    const uint64_t rank =
+        std::max(uint64_t(1), uint64_t(std::ceil(clamped / 100.0 * _count)));
+
+    uint64_t accumulated = 0;
+    for (size_t i = 0; i != _buckets.size(); ++i)
+    {
+        accumulated += _buckets[i];
+        if (accumulated >= rank)
+            return std::min(_bucketUpperBound(i), _max);
+    }
+    return _max;
+}
+
+std::ostream& operator<<(std::ostream& os, const Histogram& histogram)
+{
+    return os << "count " << histogram.getCount() << " mean "
+              << histogram.getMean() << " min " << histogram.getMin()
+              << " p50 " << histogram.getPercentile(50) << " p90 "
+              << histogram.getPercentile(90) << " p99 "
+              << histogram.getPercentile(99) << " p99.9 "
+              << histogram.getPercentile(99.9) << " max "
+              << histogram.getMax();
+}
+}
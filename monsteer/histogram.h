@@ -0,0 +1,82 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_HISTOGRAM_H
+#define MONSTEER_HISTOGRAM_H
+
+#include <monsteer/types.h>
+
+#include <iosfwd>
+#include <vector>
+
+namespace monsteer
+{
+/**
+ * Histogram of non-negative integer values with logarithmic buckets.
+ *
+ * Values below 128 are counted exactly, larger values are counted in buckets
+ * whose width is 1/64th of their magnitude, so percentiles are reported with
+ * a relative error below 1.6% over the full 64-bit range. The buckets are
+ * allocated up to the largest value recorded: 1 KB for values below 128,
+ * under 8 KB for values up to a million and at most 3776 buckets (about
+ * 30 KB). This is the log-linear bucketing scheme of HdrHistogram.
+ *
+ * Recording is constant time and allocation free once a bucket has been
+ * used, so it can be used in timing critical loops. Not thread safe.
+ */
+class Histogram
+{
+public:
+    /** Count one or more occurrences of a value. */
+    void record(uint64_t value, uint64_t count = 1);
+
+    /** Add all the values of another histogram to this one. */
+    void merge(const Histogram& other);
+
+    /** Remove all the recorded values. */
+    void reset();
+
+    /** @return the number of recorded values. */
+    uint64_t getCount() const { return _count; }
+    /** @return the smallest recorded value, 0 if empty. */
+    uint64_t getMin() const { return _count ? _min : 0; }
+    /** @return the largest recorded value, 0 if empty. */
+    uint64_t getMax() const { return _max; }
+    /** @return the mean of the recorded values, 0 if empty. */
+    double getMean() const;
+
+    /**
+     * @return the value below which the given percentage of the recorded
+     *         values fall, within the precision of the buckets. 0 if empty.
+     * @param percentile in [0, 100].
+     */
+    uint64_t getPercentile(double percentile) const;
+
+private:
+    std::vector<uint64_t> _buckets;
+    uint64_t _count = 0;
+    uint64_t _min = 0;
+    uint64_t _max = 0;
+    double _total = 0;
+};
+
+/** Print count, mean, min, max and the main percentiles of a histogram. */
+std::ostream& operator<<(std::ostream& os, const Histogram& histogram);
+}
+
+#endif
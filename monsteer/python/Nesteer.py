@@ -9,12 +9,299 @@
 import monsteer as _monsteer
 
 from six.moves import cPickle as _pickle
+import base64 as _base64
+import hashlib as _hashlib
+import heapq as _heapq
 import itertools as _itertools
 import json as _json
+import math as _math
 import nest as _nest
 import numpy as _numpy
 import os.path
+import struct as _struct
 import sys as _sys
+import time as _time
+
+# Layout of the steering messages sent by music_proxy, see
+# monsteer/steering/musicMessage.h
+_MESSAGE_MAGIC = 0x5254534d
+_MESSAGE_VERSION = 1
+_RECORD_STIMULUS_INJECTION = 1
+_RECORD_TIMING = 2
+_RECORD_COMPACT_STIMULUS_INJECTION = 3
+_RECORD_STIMULUS_UPDATE = 4
+_RECORD_STIMULUS_REMOVAL = 5
+_RECORD_STIMULUS_TEMPLATE = 6
+_CELLS_LIST = 0
+_CELLS_RANGES = 1
+_CELLS_BITMAP = 2
+
+# Kinds of the requests returned by _decode_message
+_INJECT = 0
+_UPDATE = 1
+_REMOVE = 2
+_TEMPLATE = 3
+
+# Default acceptable latency of the MUSIC steering port in ms.
+_DEFAULT_ACCEPTABLE_LATENCY = 40.0
+# Default simulation step in ms between calls to process_events.
+_DEFAULT_SIMULATION_STEP = 10.0
+# Default MUSIC time step in ms of music_proxy, and the fraction of its
+# --steering-latency that selects the time step (see apps/music_proxy.cpp).
+_DEFAULT_MUSIC_TIMESTEP = 0.1
+_TICK_LATENCY_FRACTION = 0.25
+
+
+def _padded_size(size):
+    return (size + 3) & ~3
+
+
+def _decode_cells(encoding, words):
+    """
+    Decodes the cells of a compact stimulus injection, see
+    monsteer/steering/cellSet.h
+    """
+    if encoding == _CELLS_LIST:
+        return words
+    if encoding == _CELLS_RANGES:
+        ranges = words.reshape(-1, 3).astype(_numpy.int64)
+        if len(ranges) == 0:
+            return _numpy.empty(0, dtype=_numpy.uint32)
+        return _numpy.concatenate(
+            [first + stride * _numpy.arange(count, dtype=_numpy.int64)
+             for first, count, stride in ranges]).astype(_numpy.uint32)
+    if encoding == _CELLS_BITMAP:
+        bits = _numpy.unpackbits(words[1:].view(_numpy.uint8),
+                                 bitorder='little')
+        return (words[0] + _numpy.flatnonzero(bits)).astype(_numpy.uint32)
+    raise ValueError('Unknown cell encoding {0}'.format(encoding))
+
+
+def _decode_parameters(names, values, json_params):
+    params = _json.loads(json_params) if json_params else {}
+    if names:
+        params.update(zip(names.split(';'), values))
+    return params
+
+
+def _decode_message(message):
+    """
+    Decodes a steering message.
+
+    Returns the list of requests in the message and the (receive_time,
+    send_time, simulation_time) tuple of the timing record, or None if not
+    present. The requests are tuples of one of these forms:
+    - (_INJECT, messageID, params, cells, multiple, onset, templateID),
+      where params is a parameter dictionary, cells an array of gids, onset
+      the simulation time in ms at which the stimulus starts (0 for
+      immediately) and templateID the template overridden by params (0 for
+      none).
+    - (_UPDATE, stimulusID, params)
+    - (_REMOVE, stimulusID)
+    - (_TEMPLATE, templateID, params)
+    """
+    # Messages from older proxies carry a single event in JSON.
+    if message.startswith('{'):
+        event = _json.loads(message)
+        if event['eventType'] != 'EVENT_STIMULUSINJECTION':
+            return [], None
+        return [(_INJECT, event['messageID'], _json.loads(event['params']),
+                 event['cells'], event['multiple'], 0)], None
+
+    data = _base64.b64decode(message)
+    magic, version, count, _ = _struct.unpack_from('=4I', data, 0)
+    if magic != _MESSAGE_MAGIC or version != _MESSAGE_VERSION:
+        raise ValueError('Unsupported steering message')
+
+    requests = []
+    timing = None
+    offset = 16
+    for i in range(count):
+        record_type, size = _struct.unpack_from('=2I', data, offset)
+        offset += 8
+        if record_type == _RECORD_STIMULUS_INJECTION:
+            flags, params_size, cell_count = \
+                _struct.unpack_from('=3I', data, offset)
+            params_start = offset + 12
+            params = data[params_start:params_start + params_size]
+            cells = _numpy.frombuffer(
+                data, dtype=_numpy.uint32, count=cell_count,
+                offset=params_start + _padded_size(params_size))
+            requests.append((_INJECT, '', _json.loads(params.decode('utf-8')),
+                             cells, bool(flags & 1), 0))
+        elif record_type == _RECORD_COMPACT_STIMULUS_INJECTION:
+            (flags, encoding, id_low, id_high, template_low, template_high,
+             model_size, names_size, value_count, json_size, cell_words,
+             onset) = _struct.unpack_from('=11Id', data, offset)
+            start = offset + 52
+            model = data[start:start + model_size].decode('utf-8')
+            start += _padded_size(model_size)
+            names = data[start:start + names_size].decode('utf-8')
+            start += _padded_size(names_size)
+            values = _struct.unpack_from('={0}d'.format(value_count), data,
+                                         start)
+            start += value_count * 8
+            json_params = data[start:start + json_size].decode('utf-8')
+            start += _padded_size(json_size)
+            words = _numpy.frombuffer(data, dtype=_numpy.uint32,
+                                      count=cell_words, offset=start)
+
+            params = _decode_parameters(names, values, json_params)
+            if model:
+                params['model'] = [model]
+            requests.append((_INJECT, (id_high << 32) | id_low, params,
+                             _decode_cells(encoding, words), bool(flags & 1),
+                             onset, (template_high << 32) | template_low))
+        elif record_type == _RECORD_STIMULUS_UPDATE:
+            id_low, id_high, names_size, value_count, json_size = \
+                _struct.unpack_from('=5I', data, offset)
+            start = offset + 20
+            names = data[start:start + names_size].decode('utf-8')
+            start += _padded_size(names_size)
+            json_params = data[start:start + json_size].decode('utf-8')
+            start += _padded_size(json_size)
+            values = _struct.unpack_from('={0}d'.format(value_count), data,
+                                         start)
+            requests.append((_UPDATE, (id_high << 32) | id_low,
+                             _decode_parameters(names, values, json_params)))
+        elif record_type == _RECORD_STIMULUS_TEMPLATE:
+            (id_low, id_high, model_size, names_size, value_count,
+             json_size) = _struct.unpack_from('=6I', data, offset)
+            start = offset + 24
+            model = data[start:start + model_size].decode('utf-8')
+            start += _padded_size(model_size)
+            names = data[start:start + names_size].decode('utf-8')
+            start += _padded_size(names_size)
+            json_params = data[start:start + json_size].decode('utf-8')
+            start += _padded_size(json_size)
+            values = _struct.unpack_from('={0}d'.format(value_count), data,
+                                         start)
+            params = _decode_parameters(names, values, json_params)
+            if model:
+                params['model'] = [model]
+            requests.append((_TEMPLATE, (id_high << 32) | id_low, params))
+        elif record_type == _RECORD_STIMULUS_REMOVAL:
+            id_low, id_high = _struct.unpack_from('=2I', data, offset)
+            requests.append((_REMOVE, (id_high << 32) | id_low))
+        elif record_type == _RECORD_TIMING:
+            timing = _struct.unpack_from('=3d', data, offset)
+        offset += _padded_size(size)
+    return requests, timing
+
+
+def _decode_messages(messages):
+    """
+    Decodes all the pending steering messages.
+
+    Returns the requests of all the messages in order and the list of their
+    timing records, see _decode_message.
+    """
+    requests = []
+    timings = []
+    for message in messages:
+        message_requests, timing = _decode_message(message)
+        requests.extend(message_requests)
+        if timing:
+            timings.append(timing)
+    return requests, timings
+
+
+class _MessageDecoder:
+    """
+    Python version of monsteer.MessageDecoder, used if the monsteer module
+    was built without NumPy.
+    """
+    def __init__(self, get_defaults):
+        self._get_defaults = get_defaults
+        # Numeric parameter types by generator model
+        self._types = {}
+        # Generator models by template ID
+        self._template_models = {}
+
+    def decode(self, messages):
+        requests, timings = _decode_messages(messages)
+        for request in requests:
+            if request[0] == _TEMPLATE:
+                model = request[2].get('model')
+                self._template_models[request[1]] = model
+                self._coerce(model, request[2])
+            elif request[0] == _INJECT:
+                template = request[6] if len(request) > 6 else 0
+                model = request[2].get('model',
+                                       self._template_models.get(template))
+                self._coerce(model, request[2])
+        return requests, timings
+
+    def _coerce(self, model, params):
+        if not model:
+            return
+        model = model if isinstance(model, str) else str(model[0])
+        types = self._types.get(model)
+        if types is None:
+            try:
+                defaults = self._get_defaults(model)
+            except _nest.pynestkernel.NESTError:
+                defaults = {}
+            types = dict((key, type(value))
+                         for key, value in defaults.items()
+                         if type(value).__name__ in ('int', 'float'))
+            self._types[model] = types
+        for key, value in params.items():
+            if key in types:
+                params[key] = types[key](value)
+
+
+class _NeuronLookup:
+    """
+    Maps gids to NEST ids, 0 for unknown gids. Dense gids are looked up in
+    a table indexed by gid, sparse gids with a binary search in the sorted
+    gids, so the memory used stays proportional to the number of neurons.
+    """
+    # Largest table size, as a multiple of the number of gids
+    _MAX_TABLE_RATIO = 4
+
+    def __init__(self, gids, neurons):
+        self._table = None
+        if len(gids) and gids.min() >= 0 and \
+           gids.max() < len(gids) * self._MAX_TABLE_RATIO:
+            self._table = _numpy.zeros(gids.max() + 1, dtype=_numpy.int64)
+            self._table[gids] = neurons
+            return
+        order = _numpy.argsort(gids, kind='mergesort')
+        self._gids = gids[order]
+        self._neurons = neurons[order]
+
+    def __call__(self, gids):
+        if self._table is not None:
+            neurons = _numpy.take(self._table, gids, mode='clip')
+            neurons[(gids < 0) | (gids >= len(self._table))] = 0
+            return neurons
+        if not len(self._gids):
+            return _numpy.zeros(len(gids), dtype=_numpy.int64)
+        index = _numpy.minimum(_numpy.searchsorted(self._gids, gids),
+                               len(self._gids) - 1)
+        neurons = self._neurons[index]
+        neurons[self._gids[index] != gids] = 0
+        return neurons
+
+
+class _LatencyStatistics:
+    """
+    Running mean and maximum of a latency.
+    """
+    def __init__(self):
+        self.count = 0
+        self.total = 0.0
+        self.max = 0.0
+
+    def add(self, value):
+        self.count += 1
+        self.total += value
+        self.max = max(self.max, value)
+
+    def summary(self):
+        return {'mean': self.total / self.count if self.count else 0.0,
+                'max': self.max}
 
 
 def _apply_generators_to_neurons(generators, neurons):
@@ -54,28 +341,75 @@ class Simulator(_monsteer.Simulator):
 
     def injectStimulus(self, params, cells):
         """
-        injectStimulus((Simulator)arg1, (dict)arg2, (Cell_Target)arg3) -> None
+        injectStimulus((Simulator)arg1, (dict)arg2, (Cell_Target)arg3) -> Acknowledgement
         """
-        self.simulator.injectStimulus(params, cells, json_encoder=JSONEncoder)
+        return self.simulator.injectStimulus(params, cells, json_encoder=JSONEncoder)
 
     def injectMultipleStimuli(self, params, cells):
         """
-        injectMultipleStimuli((Simulator)arg1, (dict)arg2, (Cell_Target)arg3) -> None
+        injectMultipleStimuli((Simulator)arg1, (dict)arg2, (Cell_Target)arg3) -> Acknowledgement
         """
-        self.simulator.injectMultipleStimuli(params, cells,
-                                             json_encoder=JSONEncoder)
+        return self.simulator.injectMultipleStimuli(params, cells,
+                                                    json_encoder=JSONEncoder)
+
+    def compile(self, params):
+        """
+        Returns the monsteer.StimulusParameters of a parameter dictionary,
+        to be reused in several injections
+        """
+        return _monsteer.StimulusParameters(params, json_encoder=JSONEncoder)
+
+    def injectStimuli(self, injections, multiple=False):
+        """
+        Sends a list of (params, cells) or (params, cells, time) tuples in a
+        single request. params are dictionaries or compiled parameters, see
+        compile().
+        """
+        compiled = []
+        for injection in injections:
+            params = injection[0]
+            if not isinstance(params, _monsteer.StimulusParameters):
+                params = self.compile(params)
+            compiled.append((params,) + tuple(injection[1:]))
+        return self.simulator.injectStimuli(compiled, multiple)
+
+    def submit(self, batch):
+        """
+        Sends a monsteer.StimulusBatch in a single request
+        """
+        return self.simulator.submit(batch)
 
     def play(self):
         """
         Plays/Resumes the simulation
         """
-        self.simulator.play()
+        return self.simulator.play()
 
     def pause(self):
         """
         Pauses the simulation
         """
-        self.simulator.pause()
+        return self.simulator.pause()
+
+    def step(self, count):
+        """
+        Advances the simulation count music_proxy ticks and pauses it
+        """
+        return self.simulator.step(count)
+
+    def runUntil(self, timestamp):
+        """
+        Runs the simulation until timestamp (in ms) and pauses it
+        """
+        return self.simulator.runUntil(timestamp)
+
+    def getStatus(self, timeout=1.0):
+        """
+        Returns a dictionary with the simulation time in ms, the playback
+        state, the cell count and the number of active stimuli. Raises
+        RuntimeError if music_proxy does not reply within timeout seconds.
+        """
+        return self.simulator.getStatus(timeout)
 
 
 class Nesteer:
@@ -83,70 +417,387 @@ class Nesteer:
     The ISC communication class that handles MUSIC event ports for streaming
     spikes and message ports for steering input.
     """
-    def __init__(self, spike_port_name, steering_port_name, neurons, gids):
+    def __init__(self, spike_port_name, steering_port_name, neurons, gids,
+                 target_latency=None):
+        """
+        target_latency is the steering latency in ms to aim for. If given,
+        the acceptable latency of the steering port and simulation_step are
+        derived from it, music_proxy should use the same value in its
+        --steering-latency option.
+        """
         self._spike_port_name = spike_port_name
         self._steering_port_name = steering_port_name
         self._apply_generators_to_neurons_function = _apply_generators_to_neurons
+        # Generators of the active stimuli by message ID
         self._generator_dict = {}
-        self._gid_to_neuron_map = {}
+        # Generators of removed stimuli by model, neurons and multiple
+        self._generator_pool = {}
+        # Decoded parameters of the stimulus templates by template ID
+        self._templates = {}
+        # Decodes the steering messages and converts the numeric parameters
+        # to the types of the generator defaults, compiled if available.
+        decoder = getattr(_monsteer, 'MessageDecoder', _MessageDecoder)
+        self._decoder = decoder(_nest.GetDefaults)
+        # Gids of the neurons and their NEST global ids
+        self._gids = _numpy.asarray(gids, dtype=_numpy.int64)
+        self._neurons = None
+        # Maps gids to NEST ids, see _NeuronLookup
+        self._neuron_lookup = None
+        # Generator defaults by model, cached during process_events
+        self._defaults = {}
         self._event_function_dict = {}
+        self._simulation_latency = _LatencyStatistics()
+        self._wall_latency = _LatencyStatistics()
+        # Scheduled injections received after their onset time
+        self.late_injections = 0
+        # Heap of the (onset, sequence, injection) scheduled injections of
+        # the models without origin, injected when the onset is reached
+        self._deferred = []
+        self._deferred_sequence = _itertools.count()
+
+        if target_latency:
+            self._acceptable_latency = target_latency * 0.5
+            music_timestep = target_latency * _TICK_LATENCY_FRACTION
+            # Half of the largest chunk, so run() has room to grow the
+            # chunks while idle
+            self.simulation_step = target_latency * 0.125
+        else:
+            self._acceptable_latency = _DEFAULT_ACCEPTABLE_LATENCY
+            self.simulation_step = _DEFAULT_SIMULATION_STEP
+            music_timestep = _DEFAULT_MUSIC_TIMESTEP
+        # Largest simulation chunk of run() while no steering arrives. A
+        # message waits up to a MUSIC tick in music_proxy and the acceptable
+        # latency in the port, so the steering latency stays below
+        # acceptable latency + max_simulation_step + tick, which is the
+        # target latency if given.
+        self.max_simulation_step = max(
+            self._acceptable_latency - music_timestep, self.simulation_step)
 
-        for (neuron, gid) in zip(neurons, gids):
-            status = _nest.GetStatus([neuron])
-            global_id = status[0]['global_id']
-            self._gid_to_neuron_map[gid] = global_id
+        # The global ids of all the neurons are queried in a single call
+        neurons = list(neurons)
+        if len(neurons) != len(self._gids):
+            raise ValueError('The number of neurons and gids differ')
+        self._neurons = _numpy.asarray(
+            _nest.GetStatus(neurons, 'global_id') if neurons else [],
+            dtype=_numpy.int64)
+        self._neuron_lookup = _NeuronLookup(self._gids, self._neurons)
 
         self._setup_music()
 
+    def run(self, duration):
+        """
+        Simulates duration ms, processing the steering events in between.
+
+        The simulation advances in chunks of simulation_step ms after
+        steering messages arrive, to keep the latency low. While no message
+        arrives, the chunks double up to max_simulation_step ms, so fewer
+        calls to nest.Simulate are needed. A chunk also ends at the onset of
+        the next pending scheduled injection. The messages already received
+        are processed before the first chunk.
+        """
+        resolution = _nest.GetKernelStatus('resolution')
+        self.process_events()
+        now = _nest.GetKernelStatus('time')
+        end = now + duration
+        step = self.simulation_step
+        while end - now > resolution * 0.5:
+            chunk = min(step, end - now)
+            if self._deferred:
+                chunk = min(chunk, self._deferred[0][0] - now)
+            # Rounded up to whole simulation steps, reaching the onsets
+            chunk = max(1, _math.ceil(chunk / resolution - 1e-6)) * resolution
+            _nest.Simulate(chunk)
+            now = _nest.GetKernelStatus('time')
+
+            if self.process_events():
+                step = self.simulation_step
+            else:
+                step = min(step * 2, max(self.max_simulation_step,
+                                         self.simulation_step))
+
     def process_events(self):
         """
-        Processes incoming events from steering port
+        Processes incoming events from steering port and injects the
+        scheduled stimuli whose onset has been reached. Returns whether any
+        steering message was received.
         """
         event = _nest.GetStatus(self._music_steering_input, 'data')
         messages = event[0]['messages']
-        if len(messages) == 0:
-            return
+        if len(messages) != 0:
+            self.process_messages(messages)
+            # Clear messages
+            _nest.SetStatus(self._music_steering_input, {'n_messages':0})
+
+        if self._deferred:
+            self._defaults = {}
+            self._now = _nest.GetKernelStatus('time')
+            self._inject_deferred()
+        return len(messages) != 0
+
+    def process_messages(self, messages):
+        """
+        Applies a list of steering messages as received from the steering
+        port. process_events calls it, it is exposed to profile the steering
+        without MUSIC, see benchmarks/python_bindings.py.
+        """
+        self._defaults = {}
+        self._now = _nest.GetKernelStatus('time')
+        requests, timings = self._decoder.decode(messages)
+
+        # Consecutive injections are applied together, grouping the NEST
+        # calls of the generators of the same model. Updates and removals
+        # may refer to them, so they flush the pending injections first.
+        injections = []
+        for request in requests:
+            if request[0] == _INJECT:
+                injection = self._prepare_injection(*request[1:])
+                if injection:
+                    injections.append(injection)
+            elif request[0] == _TEMPLATE:
+                self._templates[request[1]] = request[2]
+            else:
+                self._inject(injections)
+                injections = []
+                if self._change_deferred(*request):
+                    continue
+                if request[0] == _UPDATE:
+                    self._update_generators(*request[1:])
+                elif request[0] == _REMOVE:
+                    self._remove_generators(*request[1:])
+        self._inject(injections)
 
-        for message in messages:
-            event_dict = _json.loads(message)
-            if event_dict['eventType'] == 'EVENT_STIMULUSINJECTION':
-                params_dict = _json.loads(event_dict['params'])
-                self._apply_generators_to_neurons(event_dict['messageID'],
-                                                  params_dict,
-                                                  event_dict['cells'],
-                                                  event_dict['multiple'])
+        for timing in timings:
+            self._add_latency_sample(timing)
+
+    def steering_latency(self):
+        """
+        Returns the statistics of the latency in ms between the receipt of
+        the steering requests by music_proxy and their application, both in
+        simulation and wall clock time. The wall clock values are only
+        meaningful if the clocks of both hosts are synchronized.
+        """
+        return {'messages': self._simulation_latency.count,
+                'simulation': self._simulation_latency.summary(),
+                'wall_clock': self._wall_latency.summary()}
 
-        # Clear messages
-        _nest.SetStatus(self._music_steering_input, {'n_messages':0})
+    def _add_latency_sample(self, timing):
+        receive_time, send_time, simulation_time = timing
+        self._simulation_latency.add(self._now - simulation_time)
+        self._wall_latency.add((_time.time() - receive_time) * 1000.0)
 
-    def _apply_generators_to_neurons(self, uuid, parameters, gids, multiple):
+    def _prepare_injection(self, uuid, parameters, gids, multiple, onset=0,
+                           template=0):
         """
-        Creates the generator(s), sets status and does the mapping
-        between gids and nest neurons.
+        Resolves the parameters and the NEST neurons of a stimulus injection.
+        Returns a (uuid, generator_name, parameters, neurons, multiple) tuple,
+        or None if the injection cannot be applied.
         """
+        if template:
+            if template not in self._templates:
+                print('Unknown stimulus template {0}'.format(template))
+                return None
+            # The parameters of the injection override those of the template
+            parameters = dict(self._templates[template], **parameters)
         generator_name = str(parameters['model'][0])
         del parameters['model'] # Removed to avoid a spurious exception
-        generators = _nest.Create(generator_name, len(gids) if multiple else 1)
-        try:
-            # Coercing numeric parameter types to avoid errors
+
+        neurons = self._get_neurons(gids)
+        if len(neurons) == 0:
+            return None
+
+        injection = (uuid, generator_name, parameters, neurons, multiple)
+        if onset > 0:
+            if onset < self._now:
+                self.late_injections += 1
+            if 'origin' in self._get_defaults(generator_name):
+                # The start and stop times of NEST stimulating devices are
+                # relative to their origin, so the onset is exact regardless
+                # of when the request arrives, unless it arrives late. An
+                # origin given by the user is relative to the onset.
+                parameters['origin'] = parameters.get('origin', 0.0) + onset
+            elif onset > self._now:
+                # Other models are injected when the onset is reached, see
+                # run() and process_events().
+                _heapq.heappush(self._deferred, (
+                    onset, next(self._deferred_sequence), injection))
+                return None
+        return injection
+
+    def _inject_deferred(self):
+        """
+        Injects the deferred injections whose onset has been reached.
+        """
+        injections = []
+        while self._deferred and self._deferred[0][0] <= self._now:
+            injections.append(_heapq.heappop(self._deferred)[2])
+        self._inject(injections)
+
+    def _change_deferred(self, kind, uuid, parameters=None):
+        """
+        Applies an update or removal to a deferred injection. Returns False
+        if the stimulus is not deferred.
+        """
+        for i, (_, _, injection) in enumerate(self._deferred):
+            if uuid and injection[0] == uuid:
+                break
+        else:
+            return False
+        if kind == _UPDATE:
+            injection[2].update(parameters)
+        else:
+            self._deferred.pop(i)
+            _heapq.heapify(self._deferred)
+        return True
+
+    def _get_neurons(self, gids):
+        """
+        Maps gids to NEST neurons, dropping the unknown gids.
+        """
+        gids = _numpy.asarray(gids, dtype=_numpy.int64)
+        neurons = self._neuron_lookup(gids)
+        if not neurons.all():
+            print('Ignoring {0} unknown cells'.format(
+                len(neurons) - _numpy.count_nonzero(neurons)))
+            neurons = neurons[neurons != 0]
+        return neurons
+
+    def _inject(self, injections):
+        """
+        Creates or reuses the generators of the prepared injections, sets
+        their status and connects them to the neurons. The new generators
+        of a model are created with a single nest.Create call and set with a
+        single nest.SetStatus call.
+        """
+        new_injections = {}
+        for injection in injections:
+            uuid, generator_name, parameters, neurons, multiple = injection
+
+            # NEST nodes cannot be deleted, so the generators of removed
+            # stimuli are reused by the stimuli of the same model on the
+            # same neurons. The neurons are keyed by a digest to not keep a
+            # copy of them per stimulus.
+            pool_key = (generator_name, len(neurons), _hashlib.sha1(
+                _numpy.ascontiguousarray(neurons)).digest(), multiple)
+            pool = self._generator_pool.get(pool_key)
+            if pool:
+                generators, modified = pool.pop()
+                defaults = self._get_defaults(generator_name)
+                self._set_generator_status(
+                    generator_name, generators,
+                    dict((key, defaults[key]) for key in modified))
+                self._set_generator_status(generator_name, generators,
+                                           parameters)
+                self._add_stimulus(uuid, generator_name, pool_key,
+                                   generators, parameters)
+            else:
+                new_injections.setdefault(generator_name, []).append(
+                    (injection, pool_key))
+
+        for generator_name, group in new_injections.items():
+            counts = [len(neurons) if multiple else 1
+                      for (_, _, _, neurons, multiple), _ in group]
+            all_generators = _nest.Create(generator_name, sum(counts))
+
+            start = 0
+            statuses = []
+            connections = []
+            for (injection, pool_key), count in zip(group, counts):
+                uuid, _, parameters, neurons, _ = injection
+                generators = all_generators[start:start + count]
+                start += count
+                statuses.extend([parameters] * count)
+                connections.append((generators, neurons))
+                self._add_stimulus(uuid, generator_name, pool_key, generators,
+                                   parameters)
+
+            if len(group) == 1:
+                statuses = group[0][0][2]
+            try:
+                _nest.SetStatus(all_generators, statuses)
+            except _nest.pynestkernel.NESTError:
+                # Applied one stimulus at a time to isolate the failing one
+                start = 0
+                for ((injection, _), count) in zip(group, counts):
+                    self._set_generator_status(
+                        generator_name, all_generators[start:start + count],
+                        injection[2])
+                    start += count
+
+            # Connected once the parameters are set, so that the user
+            # function sees the generators as they will be simulated
+            for generators, neurons in connections:
+                self._apply_generators_to_neurons_function(generators,
+                                                           neurons.tolist())
+
+    def _add_stimulus(self, uuid, generator_name, pool_key, generators,
+                      parameters):
+        if uuid:
+            self._generator_dict[uuid] = (generator_name, pool_key, generators,
+                                          set(parameters.keys()))
+
+    def _update_generators(self, uuid, parameters):
+        """
+        Changes the parameters of the generators of a stimulus.
+        """
+        if uuid not in self._generator_dict:
+            print('Unknown stimulus {0}'.format(uuid))
+            return
+        generator_name, _, generators, modified = self._generator_dict[uuid]
+        self._set_generator_status(generator_name, generators, parameters)
+        modified.update(parameters.keys())
+
+    def _remove_generators(self, uuid):
+        """
+        Silences the generators of a stimulus and keeps them for reuse.
+        """
+        if uuid not in self._generator_dict:
+            print('Unknown stimulus {0}'.format(uuid))
+            return
+        generator_name, pool_key, generators, modified = \
+            self._generator_dict.pop(uuid)
+        silence = {'origin': 0.0, 'start': 0.0,
+                   'stop': self._now}
+        if not self._set_generator_status(generator_name, generators,
+                                          silence):
+            # Reusing them could leave the old stimulus running
+            print('Could not silence the generators of stimulus {0}, '
+                  'not reusing them'.format(uuid))
+            return
+        modified.update(silence.keys())
+        self._generator_pool.setdefault(pool_key, []).append(
+            (generators, modified))
+
+    def _get_defaults(self, generator_name):
+        defaults = self._defaults.get(generator_name)
+        if defaults is None:
             defaults = _nest.GetDefaults(generator_name)
-            for key, value in parameters.items():
-                value_type = type(defaults[key])
-                type_name = value_type.__name__
-                if type_name == 'int' or type_name == 'float':
-                    parameters[key] = value_type(value)
+            self._defaults[generator_name] = defaults
+        return defaults
+
+    def _coerce_parameters(self, generator_name, parameters):
+        # Coercing numeric parameter types to avoid errors
+        defaults = self._get_defaults(generator_name)
+        for key, value in parameters.items():
+            if key not in defaults:
+                continue
+            type_name = type(defaults[key]).__name__
+            if type_name == 'int' or type_name == 'float':
+                parameters[key] = type(defaults[key])(value)
+
+    def _set_generator_status(self, generator_name, generators, parameters):
+        """
+        Returns False if NEST rejected the parameters. Parameters unknown to
+        the model raise a DictError once the known ones are set, which is
+        not considered a failure.
+        """
+        try:
+            self._coerce_parameters(generator_name, parameters)
             _nest.SetStatus(generators, parameters)
         except _nest.pynestkernel.NESTError as e:
             if 'DictError' not in str(e):
                 print(e)
-
-        self._generator_dict[uuid] = generators
-
-        neurons = []
-        for gid in gids:
-            neurons.append(self._gid_to_neuron_map[gid])
-
-        self._apply_generators_to_neurons_function(generators, neurons)
+                return False
+        return True
 
     def set_apply_generators_to_neurons_function(self, function):
         """
@@ -170,13 +821,24 @@ class Nesteer:
                         {'port_name': self._spike_port_name})
 
         # Connecting neurons to music event channels. In case of the BBP
-        # circuit, each channel corresponds to a gid.
-        for gid, neuron in self._gid_to_neuron_map.items():
-            _nest.Connect([neuron], self._music_spike_output, 'one_to_one',
-                          {'music_channel': gid})
+        # circuit, each channel corresponds to a gid. The channels are given
+        # as an array to make all the connections in a single call, with a
+        # connection per neuron as fallback for the NEST versions that do
+        # not support array parameters in the synapse specification.
+        if len(self._neurons):
+            try:
+                _nest.Connect(self._neurons.tolist(),
+                              self._music_spike_output, 'all_to_all',
+                              {'music_channel': self._gids.reshape(1, -1)})
+            except (_nest.pynestkernel.NESTError, ValueError) as e:
+                print('Connecting MUSIC channels one by one: ' + str(e))
+                for gid, neuron in zip(self._gids.tolist(),
+                                       self._neurons.tolist()):
+                    _nest.Connect([neuron], self._music_spike_output,
+                                  'one_to_one', {'music_channel': gid})
 
         # Setup music steering input.
         self._music_steering_input = _nest.Create('music_message_in_proxy', 1)
         _nest.SetStatus(self._music_steering_input,
                         {'port_name': self._steering_port_name,
-                         'acceptable_latency': 40.0})
+                         'acceptable_latency': self._acceptable_latency})
@@ -22,19 +22,22 @@ Simulator._injectStimulus = Simulator.injectStimulus
 Simulator._injectMultipleStimuli = Simulator.injectMultipleStimuli
 
 def _dictToString(dict, json_encoder):
+    # StimulusParameters are passed through, they are already compiled
+    if isinstance(dict, StimulusParameters):
+        return dict
     return (_json.dumps(dict) if json_encoder is None
             else _json.dumps(dict, cls=json_encoder))
 
 def _simulator_inject_stimulus(self, parameters, cell_ids,
                                json_encoder = None):
-    """injectStimulus( (Simulator)arg1, (dict)arg2, (cell_ids)arg3, (JSONEncoder)arg4) -> None
+    """injectStimulus( (Simulator)arg1, (dict or StimulusParameters)arg2, (cell_ids)arg3, (JSONEncoder)arg4) -> Acknowledgement
     """
     parameters = _dictToString(parameters, json_encoder)
     return Simulator._injectStimulus(self, parameters, cell_ids)
 
 def _simulator_inject_multiple_stimuli(self, parameters, cell_ids,
                                        json_encoder = None):
-    """injectMultipleStimuli( (Simulator)arg1, (dict)arg2, (cell_ids)arg3, (JSONEncoder)arg4) -> None
+    """injectMultipleStimuli( (Simulator)arg1, (dict or StimulusParameters)arg2, (cell_ids)arg3, (JSONEncoder)arg4) -> Acknowledgement
     """
     parameters = _dictToString(parameters, json_encoder)
     return Simulator._injectMultipleStimuli(self, parameters, cell_ids)
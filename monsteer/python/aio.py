@@ -0,0 +1,185 @@
+##
+## Monsteer
+## This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+##
+## contact: jhernando@fi.upm.es
+
+"""
+asyncio front end of the steering client and the spike streams.
+
+Requests are sent from the event loop. The simulator and each spike stream
+expose a file descriptor that becomes readable when one of their replies or
+reads completes, which the event loop watches with add_reader. Then the
+pending replies are checked with ready(). Nothing blocks the event loop, so
+a notebook can steer a simulation and consume its spikes at the same time.
+Requires Python 3.5.
+"""
+
+import asyncio as _asyncio
+import os as _os
+
+import monsteer as _monsteer
+
+_NO_REPLY = 'No reply from the simulation'
+
+
+class _Watcher(object):
+    """
+    Resolves the asyncio futures of the pending replies of a descriptor
+    when the descriptor becomes readable. The descriptor may be shared by
+    several simulators, there is a watcher per event loop and descriptor.
+    """
+    _watchers = {}
+
+    @classmethod
+    def wait(cls, descriptor, pending):
+        """
+        Returns an asyncio future resolved when pending, an object with a
+        ready() method such as monsteer.Acknowledgement, is ready.
+        """
+        loop = _asyncio.get_event_loop()
+        future = loop.create_future()
+        if pending.ready():
+            future.set_result(None)
+            return future
+
+        key = (loop, descriptor)
+        watcher = cls._watchers.get(key)
+        if watcher is None:
+            watcher = cls._watchers[key] = _Watcher(loop, descriptor)
+        watcher._pending.append((pending, future))
+        future.add_done_callback(watcher._on_done)
+        return future
+
+    def __init__(self, loop, descriptor):
+        self._loop = loop
+        self._descriptor = descriptor
+        self._pending = []
+        loop.add_reader(descriptor, self._on_readable)
+
+    def _on_readable(self):
+        # Drained before the checks, a reply completed meanwhile notifies
+        # the descriptor again.
+        try:
+            while _os.read(self._descriptor, 4096):
+                pass
+        except BlockingIOError:
+            pass
+        for pending, future in list(self._pending):
+            if not future.done() and pending.ready():
+                future.set_result(None)
+
+    def _on_done(self, future):
+        # Also called on cancellation
+        self._pending = [(p, f) for p, f in self._pending if f is not future]
+        if not self._pending:
+            self._loop.remove_reader(self._descriptor)
+            del _Watcher._watchers[(self._loop, self._descriptor)]
+
+
+async def _wait(descriptor, pending, timeout):
+    """
+    Waits up to timeout seconds (forever if None) for a pending reply and
+    returns it.
+    """
+    try:
+        await _asyncio.wait_for(_Watcher.wait(descriptor, pending), timeout)
+    except _asyncio.TimeoutError:
+        raise RuntimeError(_NO_REPLY)
+    return pending.wait(0)
+
+
+class AsyncSimulator:
+    """
+    Steers a simulation like monsteer.Simulator, the requests are coroutines
+    that return the simulation time in ms at which they were applied.
+    """
+    def __init__(self, uri, json_encoder=None):
+        """
+        json_encoder is the JSONEncoder class used to serialize the stimulus
+        parameters.
+        """
+        self.simulator = _monsteer.Simulator(uri)
+        self._json_encoder = json_encoder
+        self._descriptor = self.simulator.fileno()
+        if self._descriptor < 0:
+            raise RuntimeError('The simulator plugin of {0} does not provide '
+                               'a reply descriptor'.format(uri))
+
+    async def injectStimulus(self, params, cells, timeout=None):
+        """
+        Injects a stimulus with the params dictionary in cells, any
+        sequence or array of gids.
+        """
+        return await self._wait(
+            self.simulator.injectStimulus(params, cells,
+                                          json_encoder=self._json_encoder),
+            timeout)
+
+    async def injectMultipleStimuli(self, params, cells, timeout=None):
+        """
+        Injects a stimulus per cell with the params dictionary.
+        """
+        return await self._wait(
+            self.simulator.injectMultipleStimuli(
+                params, cells, json_encoder=self._json_encoder), timeout)
+
+    async def play(self, timeout=None):
+        return await self._wait(self.simulator.play(), timeout)
+
+    async def pause(self, timeout=None):
+        return await self._wait(self.simulator.pause(), timeout)
+
+    async def step(self, count, timeout=None):
+        return await self._wait(self.simulator.step(count), timeout)
+
+    async def runUntil(self, timestamp, timeout=None):
+        return await self._wait(self.simulator.runUntil(timestamp), timeout)
+
+    async def getStatus(self, timeout=1.0):
+        """
+        Returns the status dictionary of monsteer.Simulator.getStatus.
+        """
+        return await self._wait(self.simulator.requestStatus(), timeout)
+
+    def _wait(self, pending, timeout):
+        return _wait(self._descriptor, pending, timeout)
+
+
+class AsyncSpikeStream:
+    """
+    Asynchronous iterator over the spikes of a stream in windows of
+    simulation time, as the NumPy record arrays of monsteer.SpikeStream.
+    The iteration ends with the stream or when close() is called.
+    """
+    def __init__(self, uri='monsteer://', window=10.0):
+        """
+        window is the simulation time in ms covered by each batch.
+        """
+        self.stream = _monsteer.SpikeStream(uri)
+        self.window = window
+        self._closed = False
+
+    def __aiter__(self):
+        return self
+
+    async def __anext__(self):
+        if self._closed or self.stream.getState() != 'OK':
+            raise StopAsyncIteration
+        end = self.stream.getCurrentTime() + self.window
+        pending = self.stream.readUntilAsync(end)
+        await _Watcher.wait(self.stream.fileno(), pending)
+        try:
+            return pending.get()
+        except RuntimeError:
+            # Reads interrupted by close() raise
+            if self._closed:
+                raise StopAsyncIteration
+            raise
+
+    def close(self):
+        """
+        Ends the iteration, interrupting the read in progress.
+        """
+        self._closed = True
+        self.stream.interrupt()
@@ -0,0 +1,43 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_BINDING_ALLOWTHREADS_H
+#define MONSTEER_BINDING_ALLOWTHREADS_H
+
+#include <Python.h>
+
+/**
+ * Releases the GIL in the scope of the object, so other Python threads keep
+ * running while a binding blocks. No Python object may be used in the scope.
+ */
+class AllowThreads
+{
+public:
+    AllowThreads()
+        : _state(PyEval_SaveThread())
+    {
+    }
+    ~AllowThreads() { PyEval_RestoreThread(_state); }
+    AllowThreads(const AllowThreads&) = delete;
+    AllowThreads& operator=(const AllowThreads&) = delete;
+
+private:
+    PyThreadState* _state;
+};
+
+#endif
@@ -0,0 +1,113 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <boost/python.hpp>
+
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include "arrays.h"
+
+#include <memory>
+
+using namespace boost::python;
+
+namespace
+{
+static_assert(sizeof(brion::Spike) == 2 * sizeof(uint32_t),
+              "Spikes must be a packed (float time, uint32 gid) pair to be "
+              "exposed as NumPy records");
+
+PyArray_Descr* _getSpikeType()
+{
+    static PyArray_Descr* type = nullptr;
+    if (!type)
+    {
+        list fields;
+        fields.append(make_tuple("time", "f4"));
+        fields.append(make_tuple("gid", "u4"));
+        if (!PyArray_DescrConverter(fields.ptr(), &type))
+            throw_error_already_set();
+    }
+    Py_INCREF(type); // Stolen by the array constructors
+    return type;
+}
+
+PyArray_Descr* _getIdType()
+{
+    return PyArray_DescrFromType(NPY_UINT32);
+}
+
+template <typename T>
+void _delete(PyObject* capsule)
+{
+    delete static_cast<T*>(PyCapsule_GetPointer(capsule, nullptr));
+}
+
+// The vector is moved into a capsule that becomes the base object of the
+// array, so the array uses its buffer without copying it.
+template <typename T>
+object _toArray(std::vector<T>&& values, PyArray_Descr* type)
+{
+    npy_intp size = values.size();
+    if (values.empty())
+    {
+        PyObject* array = PyArray_Empty(1, &size, type, /*fortran*/ 0);
+        if (!array)
+            throw_error_already_set();
+        return object(handle<>(array));
+    }
+
+    using Vector = std::vector<T>;
+    std::unique_ptr<Vector> owner(new Vector(std::move(values)));
+    handle<> base(PyCapsule_New(owner.get(), nullptr, _delete<Vector>));
+    Vector* data = owner.release();
+
+    handle<> array(PyArray_NewFromDescr(&PyArray_Type, type, 1, &size,
+                                        nullptr, data->data(),
+                                        NPY_ARRAY_CARRAY, nullptr));
+    if (PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(array.get()),
+                              base.release()) != 0)
+    {
+        throw_error_already_set();
+    }
+    return object(array);
+}
+}
+
+void importNumPy()
+{
+    static bool imported = false;
+    if (imported)
+        return;
+    if (_import_array() < 0)
+        throw_error_already_set();
+    imported = true;
+}
+
+object toArray(brion::uint32_ts&& ids)
+{
+    importNumPy();
+    return _toArray(std::move(ids), _getIdType());
+}
+
+object toArray(brion::Spikes&& spikes)
+{
+    importNumPy();
+    return _toArray(std::move(spikes), _getSpikeType());
+}
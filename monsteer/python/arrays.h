@@ -0,0 +1,40 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_BINDING_ARRAYS_H
+#define MONSTEER_BINDING_ARRAYS_H
+
+#include <boost/python/object.hpp>
+#include <brion/types.h>
+
+/**
+ * Import the NumPy C API. Called before creating the first array, so the
+ * bindings that do not return arrays can be used without NumPy.
+ */
+void importNumPy();
+
+/** @return a uint32 NumPy array that takes over the buffer of the ids. */
+boost::python::object toArray(brion::uint32_ts&& ids);
+
+/**
+ * @return a NumPy record array with the fields 'time' (float32) and 'gid'
+ *         (uint32) that takes over the buffer of the spikes.
+ */
+boost::python::object toArray(brion::Spikes&& spikes);
+
+#endif
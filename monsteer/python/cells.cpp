@@ -0,0 +1,141 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <boost/python.hpp>
+#include <boost/python/stl_iterator.hpp>
+
+#include "cells.h"
+
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+using namespace boost::python;
+
+namespace
+{
+// Signed and 64-bit ids are checked, they would wrap around when truncated.
+template <typename T>
+uint32_t _toCell(const T value)
+{
+    const bool negative = std::is_signed<T>::value && int64_t(value) < 0;
+    if (negative || uint64_t(value) > std::numeric_limits<uint32_t>::max())
+    {
+        const std::string id = negative ? std::to_string(int64_t(value))
+                                        : std::to_string(uint64_t(value));
+        PyErr_SetString(PyExc_OverflowError,
+                        ("Cell id out of the uint32 range: " + id).c_str());
+        throw_error_already_set();
+    }
+    return uint32_t(value);
+}
+
+template <typename T>
+void _copyCells(const Py_buffer& view, brion::uint32_ts& cells)
+{
+    const size_t count = view.shape[0];
+    const Py_ssize_t stride = view.strides[0];
+    const char* data = static_cast<const char*>(view.buf);
+    const bool checked =
+        std::is_signed<T>::value || sizeof(T) > sizeof(uint32_t);
+    if (stride == sizeof(T) && !checked)
+    {
+        const T* values = reinterpret_cast<const T*>(data);
+        // A single memcpy for contiguous numpy.uint32 arrays.
+        cells.assign(values, values + count);
+        return;
+    }
+    cells.resize(count);
+    for (size_t i = 0; i != count; ++i, data += stride)
+        cells[i] = _toCell(*reinterpret_cast<const T*>(data));
+}
+
+// Copies the cells of a one dimensional buffer of integers in native byte
+// order, e.g. a NumPy array or a slice of it. Returns false for other
+// buffers, raises OverflowError for negative or too large ids.
+bool _copyCells(PyObject* object, brion::uint32_ts& cells)
+{
+    Py_buffer view;
+    if (PyObject_GetBuffer(object, &view, PyBUF_RECORDS_RO) != 0)
+    {
+        PyErr_Clear();
+        return false;
+    }
+    std::unique_ptr<Py_buffer, void (*)(Py_buffer*)> release(&view,
+                                                             PyBuffer_Release);
+    if (view.ndim != 1)
+        return false;
+
+    const char* format = view.format;
+    if (*format == '@' || *format == '=')
+        ++format;
+    if (format[0] == '\0' || format[1] != '\0' ||
+        !std::strchr("BHILQbhilq", format[0]))
+    {
+        return false;
+    }
+
+    // The lower case formats are signed.
+    const bool isSigned = std::islower(format[0]);
+    switch (view.itemsize)
+    {
+    case 1:
+        if (isSigned)
+            _copyCells<int8_t>(view, cells);
+        else
+            _copyCells<uint8_t>(view, cells);
+        return true;
+    case 2:
+        if (isSigned)
+            _copyCells<int16_t>(view, cells);
+        else
+            _copyCells<uint16_t>(view, cells);
+        return true;
+    case 4:
+        if (isSigned)
+            _copyCells<int32_t>(view, cells);
+        else
+            _copyCells<uint32_t>(view, cells);
+        return true;
+    case 8:
+        if (isSigned)
+            _copyCells<int64_t>(view, cells);
+        else
+            _copyCells<uint64_t>(view, cells);
+        return true;
+    default:
+        return false;
+    }
+}
+}
+
+brion::uint32_ts getCells(const object& list)
+{
+    brion::uint32_ts ids;
+    if (PyObject_CheckBuffer(list.ptr()) && _copyCells(list.ptr(), ids))
+        return ids;
+
+    ids.reserve(len(list));
+    stl_input_iterator<uint32_t> i(list), end;
+    while (i != end)
+        ids.push_back(*i++);
+    return ids;
+}
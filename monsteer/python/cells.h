@@ -0,0 +1,34 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_BINDING_CELLS_H
+#define MONSTEER_BINDING_CELLS_H
+
+#include <boost/python/object_fwd.hpp>
+#include <brion/types.h>
+
+/**
+ * @return the cell ids of any object supporting the buffer protocol with
+ *         one dimensional integer data, e.g. a NumPy array, read without a
+ *         Python call per cell, or of any iterable of integers.
+ * @throw boost::python::error_already_set with OverflowError if an id is
+ *        negative or does not fit in 32 bits.
+ */
+brion::uint32_ts getCells(const boost::python::object& cells);
+
+#endif
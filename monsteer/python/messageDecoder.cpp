@@ -0,0 +1,328 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <boost/python.hpp>
+#include <boost/python/stl_iterator.hpp>
+
+#include "arrays.h"
+
+#include "monsteer/steering/cellSet.h"
+#include "monsteer/steering/musicMessage.h"
+
+#include <cmath>
+#include <map>
+
+using namespace boost::python;
+using namespace monsteer::steering;
+
+namespace
+{
+// Kinds of the decoded requests, the values of Nesteer.py.
+const int INJECT = 0;
+const int UPDATE = 1;
+const int REMOVE = 2;
+const int TEMPLATE = 3;
+
+enum class ParameterType
+{
+    integer,
+    real
+};
+
+using ParameterTypes = std::map<std::string, ParameterType>;
+
+object _getID(const uint64_t id)
+{
+    return object(handle<>(PyLong_FromUnsignedLongLong(id)));
+}
+
+/**
+ * Decodes the steering messages sent by music_proxy into the requests
+ * applied by Nesteer, see _decode_message in Nesteer.py.
+ *
+ * The numeric parameters are converted to the type of the defaults of their
+ * generator model, which are queried once per model with the function given
+ * to the constructor (nest.GetDefaults).
+ */
+class MessageDecoder
+{
+public:
+    explicit MessageDecoder(const object& getDefaults)
+        : _getDefaults(getDefaults)
+        , _loads(import("json").attr("loads"))
+    {
+    }
+
+    tuple decode(const object& messages)
+    {
+        list requests;
+        list timings;
+        stl_input_iterator<std::string> i(messages), end;
+        for (; i != end; ++i)
+            _decode(*i, requests, timings);
+        return make_tuple(requests, timings);
+    }
+
+private:
+    object _getDefaults;
+    object _loads;
+    std::map<std::string, ParameterTypes> _types;
+    std::map<uint64_t, std::string> _templateModels;
+
+    void _decode(const std::string& message, list& requests, list& timings)
+    {
+        // Messages from older proxies carry a single event in JSON.
+        if (!message.empty() && message[0] == '{')
+        {
+            const object event = _loads(message);
+            if (event["eventType"] != "EVENT_STIMULUSINJECTION")
+                return;
+            object params = _loads(object(event["params"]));
+            _coerce(_getModel(params), params);
+            requests.append(make_tuple(INJECT, object(event["messageID"]),
+                                       params, object(event["cells"]),
+                                       object(event["multiple"]), 0));
+            return;
+        }
+
+        MusicMessageReader reader(message);
+        while (reader.next())
+        {
+            switch (reader.getType())
+            {
+            case MusicMessageRecord::stimulusInjection:
+            {
+                const auto record = reader.getStimulusInjection();
+                object params = _loads(record.jsonParameters);
+                _coerce(_getModel(params), params);
+                requests.append(make_tuple(
+                    INJECT, "", params,
+                    toArray(brion::uint32_ts(record.cells,
+                                             record.cells + record.cellCount)),
+                    record.multiple, 0));
+                break;
+            }
+            case MusicMessageRecord::compactStimulusInjection:
+            {
+                const auto record = reader.getCompactStimulusInjection();
+                std::string model = record.model;
+                if (model.empty())
+                {
+                    const auto i = _templateModels.find(record.templateID);
+                    if (i != _templateModels.end())
+                        model = i->second;
+                }
+                object params = _getParameters(record.parameterNames,
+                                               record.parameterValues,
+                                               record.jsonParameters, model);
+                if (!record.model.empty())
+                    params["model"] = _toList(record.model);
+                requests.append(make_tuple(
+                    INJECT, _getID(record.messageID), params,
+                    toArray(decodeCells(record.cellEncoding, record.cells,
+                                        record.cellWords)),
+                    record.multiple, record.time, _getID(record.templateID)));
+                break;
+            }
+            case MusicMessageRecord::stimulusUpdate:
+            {
+                // The model of the stimulus is only known by Nesteer, which
+                // converts the parameters.
+                const auto record = reader.getStimulusUpdate();
+                requests.append(make_tuple(
+                    UPDATE, _getID(record.stimulusID),
+                    _getParameters(record.parameterNames,
+                                   record.parameterValues,
+                                   record.jsonParameters, std::string())));
+                break;
+            }
+            case MusicMessageRecord::stimulusRemoval:
+                requests.append(
+                    make_tuple(REMOVE, _getID(reader.getStimulusRemoval())));
+                break;
+            case MusicMessageRecord::stimulusTemplate:
+            {
+                const auto record = reader.getStimulusTemplate();
+                object params = _getParameters(record.parameterNames,
+                                               record.parameterValues,
+                                               record.jsonParameters,
+                                               record.model);
+                if (!record.model.empty())
+                    params["model"] = _toList(record.model);
+                _templateModels[record.templateID] = record.model;
+                requests.append(
+                    make_tuple(TEMPLATE, _getID(record.templateID), params));
+                break;
+            }
+            case MusicMessageRecord::timing:
+            {
+                const auto timing = reader.getTiming();
+                timings.append(make_tuple(timing.receiveTime, timing.sendTime,
+                                          timing.simulationTime));
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    }
+
+    // Returns the JSON parameters overridden by the typed ones, converted to
+    // the types of the defaults of the model if given.
+    object _getParameters(const std::string& names,
+                          const std::vector<double>& values,
+                          const std::string& json, const std::string& model)
+    {
+        const ParameterTypes* types = model.empty() ? 0 : &_getTypes(model);
+        object params;
+        if (json.empty())
+            params = dict();
+        else
+        {
+            params = _loads(json);
+            if (types)
+                _coerce(*types, params);
+        }
+
+        size_t start = 0;
+        for (const double value : values)
+        {
+            if (start > names.size())
+                break;
+            size_t end = names.find(';', start);
+            if (end == std::string::npos)
+                end = names.size();
+            const std::string name = names.substr(start, end - start);
+            start = end + 1;
+
+            if (types && std::isfinite(value))
+            {
+                const auto type = types->find(name);
+                if (type != types->end() &&
+                    type->second == ParameterType::integer)
+                {
+                    params[name] = static_cast<long>(value);
+                    continue;
+                }
+            }
+            params[name] = value;
+        }
+        return params;
+    }
+
+    static list _toList(const std::string& model)
+    {
+        list models;
+        models.append(model);
+        return models;
+    }
+
+    static std::string _getModel(const object& params)
+    {
+        if (!params.contains("model"))
+            return std::string();
+        const object model = params["model"];
+        const extract<std::string> name(model);
+        return name.check() ? name() : extract<std::string>(object(model[0]));
+    }
+
+    static object _toInteger(const object& value)
+    {
+#if PY_MAJOR_VERSION >= 3
+        return object(handle<>(PyNumber_Long(value.ptr())));
+#else
+        return object(handle<>(PyNumber_Int(value.ptr())));
+#endif
+    }
+
+    static object _toReal(const object& value)
+    {
+        return object(handle<>(PyNumber_Float(value.ptr())));
+    }
+
+    const ParameterTypes& _getTypes(const std::string& model)
+    {
+        auto i = _types.find(model);
+        if (i != _types.end())
+            return i->second;
+
+        ParameterTypes& types = _types[model];
+        try
+        {
+            const list items(_getDefaults(model).attr("items")());
+            for (Py_ssize_t j = 0; j != len(items); ++j)
+            {
+                const object item = items[j];
+                const object key = item[0];
+                const extract<std::string> name(key);
+                const std::string type = extract<std::string>(
+                    item[1].attr("__class__").attr("__name__"));
+                if (!name.check())
+                    continue;
+                if (type == "int")
+                    types[name()] = ParameterType::integer;
+                else if (type == "float")
+                    types[name()] = ParameterType::real;
+            }
+        }
+        catch (const error_already_set&)
+        {
+            // Unknown model, its parameters are not converted.
+            PyErr_Clear();
+        }
+        return types;
+    }
+
+    // Converts the parameters in place.
+    void _coerce(const std::string& model, object& params)
+    {
+        if (!model.empty())
+            _coerce(_getTypes(model), params);
+    }
+
+    static void _coerce(const ParameterTypes& types, object& params)
+    {
+        if (types.empty())
+            return;
+
+        const list keys(params.attr("keys")());
+        for (Py_ssize_t j = 0; j != len(keys); ++j)
+        {
+            const object name = keys[j];
+            const extract<std::string> key(name);
+            if (!key.check())
+                continue;
+            const auto type = types.find(key());
+            if (type == types.end())
+                continue;
+            const object value = params[name];
+            params[name] = type->second == ParameterType::integer
+                               ? _toInteger(value)
+                               : _toReal(value);
+        }
+    }
+};
+}
+
+void export_MessageDecoder()
+{
+    class_<MessageDecoder, boost::noncopyable>("MessageDecoder",
+                                               init<object>(
+                                                   arg("get_defaults")))
+        .def("decode", &MessageDecoder::decode, arg("messages"));
+}
@@ -25,8 +25,18 @@
 #include <boost/python.hpp>
 
 #include "simulator.h"
+#include "stimulusBatch.h"
+#ifdef MONSTEER_USE_NUMPY
+#include "messageDecoder.h"
+#include "spikeStream.h"
+#endif
 
 BOOST_PYTHON_MODULE(_monsteer)
 {
     export_Simulator();
+    export_StimulusBatch();
+#ifdef MONSTEER_USE_NUMPY
+    export_MessageDecoder();
+    export_SpikeStream();
+#endif
 }
@@ -19,33 +19,174 @@
 
 #include <boost/python.hpp>
 
+#include "allowThreads.h"
+#include "cells.h"
+#include "stimulusBatch.h"
+
 #include "monsteer/steering/simulator.h"
+#include "monsteer/steering/stimulusBatch.h"
+#include "monsteer/steering/stimulusParameters.h"
 
-#include <boost/python/stl_iterator.hpp>
+#include <chrono>
 
 using namespace monsteer;
 using namespace boost::python;
 
-void Simulator_injectStimulus(monsteer::Simulator& simulator,
-                              const std::string& json, object list)
+namespace
+{
+template <typename T>
+bool _isReady(const std::shared_future<T>& future)
+{
+    return future.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+}
+
+// Waits with the GIL released, forever if timeout is None.
+template <typename T>
+const T& _wait(const std::shared_future<T>& future, const object& timeout)
+{
+    const bool forever = timeout.is_none();
+    const double seconds = forever ? 0.0 : extract<double>(timeout)();
+    {
+        AllowThreads allowThreads;
+        if (forever)
+            future.wait();
+        else if (future.wait_for(std::chrono::duration<double>(seconds)) !=
+                 std::future_status::ready)
+        {
+            throw std::runtime_error("No reply from the simulation");
+        }
+    }
+    return future.get();
+}
+
+dict _toDict(const SimulationStatus& status)
+{
+    const char* states[] = {"PAUSE", "PLAY", "STEP", "RUN_UNTIL"};
+    dict result;
+    result["time"] = status.time;
+    result["state"] = states[size_t(status.state)];
+    result["cell_count"] = status.cellCount;
+    result["stimulus_count"] = status.stimulusCount;
+    return result;
+}
+}
+
+// The acknowledgement of a request, see monsteer::Simulator. The wait is
+// done with the GIL released. Event loops check ready() when
+// Simulator.fileno() becomes readable.
+class Acknowledgement
+{
+public:
+    explicit Acknowledgement(std::future<double>&& future)
+        : _future(future.share())
+    {
+    }
+
+    bool ready() const { return _isReady(_future); }
+    double wait(const object& timeout) const { return _wait(_future, timeout); }
+private:
+    std::shared_future<double> _future;
+};
+
+// The reply of a status request, as Acknowledgement.
+class StatusReply
 {
-    brion::uint32_ts ids;
-    ids.reserve(len(list));
-    stl_input_iterator<uint32_t> i(list), end;
-    while (i != end)
-        ids.push_back(*i++);
-    simulator.injectStimulus(json, ids);
+public:
+    explicit StatusReply(std::future<SimulationStatus>&& future)
+        : _future(future.share())
+    {
+    }
+
+    bool ready() const { return _isReady(_future); }
+    dict wait(const object& timeout) const
+    {
+        return _toDict(_wait(_future, timeout));
+    }
+
+private:
+    std::shared_future<SimulationStatus> _future;
+};
+
+Acknowledgement Simulator_injectStimulus(monsteer::Simulator& simulator,
+                                         const std::string& json, object list)
+{
+    return Acknowledgement(simulator.injectStimulus(json, getCells(list)));
 }
 
-void Simulator_injectMultipleStimuli(monsteer::Simulator& simulator,
-                                     const std::string& json, object list)
+Acknowledgement Simulator_injectMultipleStimuli(monsteer::Simulator& simulator,
+                                                const std::string& json,
+                                                object list)
 {
-    brion::uint32_ts ids;
-    ids.reserve(len(list));
-    stl_input_iterator<uint32_t> i(list), end;
-    while (i != end)
-        ids.push_back(*i++);
-    simulator.injectMultipleStimuli(json, ids);
+    return Acknowledgement(
+        simulator.injectMultipleStimuli(json, getCells(list)));
+}
+
+Acknowledgement Simulator_injectCompiledStimulus(
+    monsteer::Simulator& simulator, const StimulusParameters& parameters,
+    object list)
+{
+    const brion::uint32_ts cells = getCells(list);
+    AllowThreads allowThreads;
+    return Acknowledgement(simulator.injectStimulus(parameters, cells));
+}
+
+Acknowledgement Simulator_injectMultipleCompiledStimuli(
+    monsteer::Simulator& simulator, const StimulusParameters& parameters,
+    object list)
+{
+    const brion::uint32_ts cells = getCells(list);
+    AllowThreads allowThreads;
+    return Acknowledgement(simulator.injectMultipleStimuli(parameters, cells));
+}
+
+Acknowledgement Simulator_submit(monsteer::Simulator& simulator,
+                                 const StimulusBatch& batch)
+{
+    AllowThreads allowThreads;
+    return Acknowledgement(simulator.submit(batch));
+}
+
+Acknowledgement Simulator_injectStimuli(monsteer::Simulator& simulator,
+                                        const object& injections,
+                                        const bool multiple)
+{
+    StimulusBatch batch;
+    addInjections(batch, injections, multiple);
+    AllowThreads allowThreads;
+    return Acknowledgement(simulator.submit(batch));
+}
+
+Acknowledgement Simulator_play(monsteer::Simulator& simulator)
+{
+    return Acknowledgement(simulator.play());
+}
+
+Acknowledgement Simulator_pause(monsteer::Simulator& simulator)
+{
+    return Acknowledgement(simulator.pause());
+}
+
+Acknowledgement Simulator_step(monsteer::Simulator& simulator,
+                               const uint32_t count)
+{
+    return Acknowledgement(simulator.step(count));
+}
+
+Acknowledgement Simulator_runUntil(monsteer::Simulator& simulator,
+                                   const double timestamp)
+{
+    return Acknowledgement(simulator.runUntil(timestamp));
+}
+
+dict Simulator_getStatus(monsteer::Simulator& simulator, const double timeout)
+{
+    return StatusReply(simulator.getStatus()).wait(object(timeout));
+}
+
+StatusReply Simulator_requestStatus(monsteer::Simulator& simulator)
+{
+    return StatusReply(simulator.getStatus());
 }
 
 SimulatorPtr Simulator_init(const std::string& uri)
@@ -55,11 +196,31 @@ SimulatorPtr Simulator_init(const std::string& uri)
 
 void export_Simulator()
 {
+    class_<Acknowledgement>("Acknowledgement", no_init)
+        .def("ready", &Acknowledgement::ready)
+        .def("wait", &Acknowledgement::wait, (arg("timeout") = object()));
+
+    class_<StatusReply>("StatusReply", no_init)
+        .def("ready", &StatusReply::ready)
+        .def("wait", &StatusReply::wait, (arg("timeout") = object()));
+
     class_<Simulator, boost::noncopyable>("Simulator", no_init)
         .def("__init__", make_constructor(Simulator_init))
         .def("injectStimulus", Simulator_injectStimulus, arg("json"))
         .def("injectMultipleStimuli", Simulator_injectMultipleStimuli,
              arg("json"))
-        .def("play", &Simulator::play)
-        .def("pause", &Simulator::pause);
+        .def("injectStimulus", Simulator_injectCompiledStimulus,
+             (arg("parameters"), arg("cells")))
+        .def("injectMultipleStimuli", Simulator_injectMultipleCompiledStimuli,
+             (arg("parameters"), arg("cells")))
+        .def("submit", Simulator_submit, arg("batch"))
+        .def("injectStimuli", Simulator_injectStimuli,
+             (arg("injections"), arg("multiple") = false))
+        .def("play", Simulator_play)
+        .def("pause", Simulator_pause)
+        .def("step", Simulator_step, arg("count"))
+        .def("runUntil", Simulator_runUntil, arg("timestamp"))
+        .def("getStatus", Simulator_getStatus, (arg("timeout") = 1.0))
+        .def("requestStatus", Simulator_requestStatus)
+        .def("fileno", &Simulator::getReplyDescriptor);
 }
@@ -0,0 +1,252 @@
+##
+## Monsteer
+## This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+##
+## contact: jhernando@fi.upm.es
+
+"""
+Shared memory ring of spike batches, to hand the spikes of a stream to
+worker processes without pickling them.
+
+A SpikeRing is written by a single process, usually from a
+monsteer.SpikeStream with SpikeRing.publish(). Any number of processes open
+it by path with SpikeRingReader and get every batch as a NumPy record array
+that is a view of the shared memory, with the 'time' and 'gid' fields of
+monsteer.SpikeStream.
+
+The ring is a file, in /dev/shm if available, with this layout:
+- Header: 8 uint64 words, see the _HEADER_ constants.
+- Batch table: slots entries of (position, count, start, end), where position
+  is the index of the first spike in the stream of all the written spikes
+  and start and end the simulation time window of the batch.
+- Spikes: capacity (time, gid) records. Batches are stored contiguously,
+  wrapping around to the beginning when a batch does not fit at the end.
+
+Readers do not block the writer, a batch is overwritten when capacity more
+spikes or slots more batches are written. Readers skip the batches they
+missed and can check with SpikeRingReader.valid() whether the view of a
+batch is still intact after using it. The header and batch table are read
+under a sequence lock: the writer makes the sequence word odd while it
+writes a batch, and readers retry if the word was odd or changed.
+"""
+
+import collections as _collections
+import os as _os
+import tempfile as _tempfile
+import time as _time
+
+import numpy as _numpy
+
+SPIKE_DTYPE = _numpy.dtype([('time', '<f4'), ('gid', '<u4')])
+
+_MAGIC = 0x474e495253544d # "MTSRING"
+_BATCH_DTYPE = _numpy.dtype([('position', '<u8'), ('count', '<u8'),
+                             ('start', '<f8'), ('end', '<f8')])
+_HEADER_WORDS = 8
+_HEADER_MAGIC = 0
+_HEADER_CAPACITY = 1
+_HEADER_SLOTS = 2
+# Number of batches written
+_HEADER_BATCHES = 3
+# Position in the spike stream up to which the data is being written
+_HEADER_RESERVED = 4
+_HEADER_ENDED = 5
+# Odd while a batch is being written
+_HEADER_SEQUENCE = 6
+
+SpikeBatch = _collections.namedtuple('SpikeBatch',
+                                     ['index', 'start', 'end', 'spikes'])
+
+
+def _default_directory():
+    return '/dev/shm' if _os.path.isdir('/dev/shm') \
+           else _tempfile.gettempdir()
+
+
+class _Ring(object):
+    def _map(self, path, mode, capacity=0, slots=0):
+        header_size = _HEADER_WORDS * 8
+        if mode == 'r':
+            header = _numpy.memmap(path, dtype='<u8', mode='r',
+                                   shape=(_HEADER_WORDS,))
+            if header[_HEADER_MAGIC] != _MAGIC:
+                raise ValueError('{0} is not a spike ring'.format(path))
+            capacity = int(header[_HEADER_CAPACITY])
+            slots = int(header[_HEADER_SLOTS])
+            del header
+        size = header_size + slots * _BATCH_DTYPE.itemsize + \
+               capacity * SPIKE_DTYPE.itemsize
+        self._memory = _numpy.memmap(path, dtype=_numpy.uint8, mode=mode,
+                                     shape=(size,))
+        self._header = self._memory[:header_size].view('<u8')
+        table_end = header_size + slots * _BATCH_DTYPE.itemsize
+        self._batches = self._memory[header_size:table_end].view(
+            _BATCH_DTYPE)
+        self._spikes = self._memory[table_end:].view(SPIKE_DTYPE)
+        self.path = path
+        self.capacity = capacity
+        self.slots = slots
+
+
+class SpikeRing(_Ring):
+    """
+    The writer of a shared memory ring of spike batches.
+    """
+    def __init__(self, name=None, capacity=1 << 22, slots=4096,
+                 directory=None):
+        """
+        Creates the ring file. capacity is the number of spikes and slots the
+        number of batches kept in the ring. If name is None a unique file
+        name is used, the path attribute is given to the readers.
+        """
+        directory = directory or _default_directory()
+        if name is None:
+            handle, path = _tempfile.mkstemp(prefix='monsteer_spikes_',
+                                             dir=directory)
+            _os.close(handle)
+        else:
+            path = _os.path.join(directory, name)
+        self._map(path, 'w+', capacity, slots)
+        self._header[_HEADER_CAPACITY] = capacity
+        self._header[_HEADER_SLOTS] = slots
+        self._header[_HEADER_MAGIC] = _MAGIC
+        self._position = 0
+        self._sequence = 0
+
+    def write(self, spikes, start=0.0, end=0.0):
+        """
+        Appends a batch of spikes, a record array with the 'time' and 'gid'
+        fields such as the ones returned by monsteer.SpikeStream, covering
+        the simulation time window [start, end).
+        """
+        count = len(spikes)
+        if count > self.capacity:
+            raise ValueError('The batch does not fit in the ring')
+        offset = self._position % self.capacity
+        if offset + count > self.capacity:
+            # Batches are contiguous, the end of the ring is skipped
+            self._position += self.capacity - offset
+            offset = 0
+        position = self._position
+        self._position += count
+
+        # The data of the batches overlapping the new one becomes invalid
+        # before it is overwritten, see SpikeRingReader.valid()
+        self._header[_HEADER_SEQUENCE] = self._sequence + 1
+        self._header[_HEADER_RESERVED] = self._position
+        self._spikes[offset:offset + count] = spikes
+        index = int(self._header[_HEADER_BATCHES])
+        self._batches[index % self.slots] = (position, count, start, end)
+        self._header[_HEADER_BATCHES] = index + 1
+        self._sequence += 2
+        self._header[_HEADER_SEQUENCE] = self._sequence
+
+    def publish(self, stream, window=10.0):
+        """
+        Writes the spikes of a monsteer.SpikeStream in batches of window ms
+        of simulation time until the stream ends, then closes the ring.
+        """
+        try:
+            while stream.getState() == 'OK':
+                start = stream.getCurrentTime()
+                end = start + window
+                self.write(stream.readUntil(end), start, end)
+        finally:
+            self.close()
+
+    def close(self):
+        """
+        Marks the ring as ended, the readers stop after the last batch.
+        """
+        self._header[_HEADER_ENDED] = 1
+        self._memory.flush()
+
+    def unlink(self):
+        """
+        Removes the ring file, the processes that mapped it keep their
+        mapping.
+        """
+        _os.unlink(self.path)
+
+
+class SpikeRingReader(_Ring):
+    """
+    A reader of a SpikeRing, usually in a worker process. Every reader gets
+    all the batches written after it was opened.
+    """
+    def __init__(self, path, poll_interval=0.001):
+        self._map(path, 'r')
+        self._poll_interval = poll_interval
+        self._next = int(self._header[_HEADER_BATCHES])
+        # Number of batches overwritten before being read
+        self.lost = 0
+
+    def read(self, timeout=None):
+        """
+        Returns the next SpikeBatch, waiting up to timeout seconds for it
+        (forever if None). Returns None on timeout or if the ring ended.
+        The spikes are a view of the shared memory.
+        """
+        deadline = None if timeout is None else _time.time() + timeout
+        while True:
+            sequence, written, _ = self._read_header()
+            if written <= self._next:
+                if self._header[_HEADER_ENDED] or \
+                   (deadline is not None and _time.time() >= deadline):
+                    return None
+                _time.sleep(self._poll_interval)
+                continue
+
+            # The slot of the oldest batch is the next one to be overwritten
+            if written + 1 - self._next > self.slots:
+                oldest = written + 1 - self.slots
+                self.lost += oldest - self._next
+                self._next = oldest
+
+            index = self._next
+            position, count, start, end = self._batches[index % self.slots]
+            if int(self._header[_HEADER_SEQUENCE]) != sequence:
+                # A batch was written while the slot was read, it may be torn
+                continue
+            self._next += 1
+            offset = int(position % self.capacity)
+            batch = SpikeBatch(index, float(start), float(end),
+                               self._spikes[offset:offset + int(count)])
+            if self.valid(batch):
+                return batch
+            self.lost += 1
+
+    def valid(self, batch):
+        """
+        Returns whether the spikes of a batch returned by read() have not
+        been overwritten yet.
+        """
+        while True:
+            sequence, written, reserved = self._read_header()
+            if written - batch.index >= self.slots:
+                return False
+            position = int(self._batches[batch.index % self.slots]['position'])
+            if int(self._header[_HEADER_SEQUENCE]) == sequence:
+                return reserved - position <= self.capacity
+
+    def _read_header(self):
+        """
+        Returns the sequence word, the number of batches written and the
+        reserved position, waiting for the batch being written if any.
+        """
+        while True:
+            sequence = int(self._header[_HEADER_SEQUENCE])
+            if sequence & 1:
+                _time.sleep(0)
+                continue
+            written = int(self._header[_HEADER_BATCHES])
+            reserved = int(self._header[_HEADER_RESERVED])
+            if int(self._header[_HEADER_SEQUENCE]) == sequence:
+                return sequence, written, reserved
+
+    def __iter__(self):
+        while True:
+            batch = self.read()
+            if batch is None:
+                return
+            yield batch
@@ -0,0 +1,220 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <boost/python.hpp>
+
+#include "allowThreads.h"
+#include "arrays.h"
+
+#include "monsteer/steering/notifier.h"
+
+#include <brion/spikeReport.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace boost::python;
+
+namespace
+{
+// A read in progress, returned by SpikeStream.readUntilAsync. Event loops
+// check ready() when SpikeStream.fileno() becomes readable.
+class PendingSpikes
+{
+public:
+    explicit PendingSpikes(std::future<brion::Spikes>&& future)
+        : _future(future.share())
+    {
+    }
+
+    bool ready() const
+    {
+        return _future.wait_for(std::chrono::seconds(0)) ==
+               std::future_status::ready;
+    }
+
+    object get() const
+    {
+        brion::Spikes spikes;
+        {
+            AllowThreads allowThreads;
+            spikes = _future.get();
+        }
+        return toArray(std::move(spikes));
+    }
+
+private:
+    std::shared_future<brion::Spikes> _future;
+};
+
+class SpikeStream
+{
+public:
+    explicit SpikeStream(const std::string& uri)
+        : _stopping(false)
+    {
+        importNumPy();
+        AllowThreads allowThreads;
+        _report.reset(
+            new brion::SpikeReport(brion::URI(uri), brion::MODE_READ));
+    }
+
+    ~SpikeStream()
+    {
+        AllowThreads allowThreads;
+        _stopReader();
+    }
+
+    object read(const float min) { return _get(_report->read(min)); }
+    object readUntil(const float max) { return _get(_report->readUntil(max)); }
+    // The reads are done in order by a single thread of the stream, which
+    // notifies fileno() after each one.
+    PendingSpikes readUntilAsync(const float max)
+    {
+        std::promise<brion::Spikes> promise;
+        PendingSpikes pending(promise.get_future());
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_stopping)
+                throw std::runtime_error("The spike stream is closed");
+            _reads.push_back(AsyncRead{max, std::move(promise)});
+            if (!_reader.joinable())
+                _reader = std::thread([this] { _readAsync(); });
+        }
+        _condition.notify_one();
+        return pending;
+    }
+
+    int fileno() const { return _notifier.getDescriptor(); }
+    float getCurrentTime() const { return _report->getCurrentTime(); }
+    float getEndTime() const { return _report->getEndTime(); }
+    std::string getState() const
+    {
+        switch (_report->getState())
+        {
+        case brion::SpikeReport::State::ok:
+            return "OK";
+        case brion::SpikeReport::State::ended:
+            return "ENDED";
+        default:
+            return "FAILED";
+        }
+    }
+
+    void interrupt() { _report->interrupt(); }
+    void close()
+    {
+        AllowThreads allowThreads;
+        _stopReader();
+        _report->close();
+    }
+
+private:
+    struct AsyncRead
+    {
+        float max;
+        std::promise<brion::Spikes> promise;
+    };
+
+    std::unique_ptr<brion::SpikeReport> _report;
+
+    monsteer::Notifier _notifier;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<AsyncRead> _reads;
+    bool _stopping;
+    std::thread _reader;
+
+    object _get(std::future<brion::Spikes>&& future)
+    {
+        brion::Spikes spikes;
+        {
+            AllowThreads allowThreads;
+            spikes = future.get();
+        }
+        return toArray(std::move(spikes));
+    }
+
+    void _readAsync()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            _condition.wait(lock,
+                            [this] { return _stopping || !_reads.empty(); });
+            if (_stopping)
+                return;
+            AsyncRead read = std::move(_reads.front());
+            _reads.pop_front();
+            lock.unlock();
+            try
+            {
+                read.promise.set_value(_report->readUntil(read.max).get());
+            }
+            catch (...)
+            {
+                read.promise.set_exception(std::current_exception());
+            }
+            _notifier.notify();
+            lock.lock();
+        }
+    }
+
+    // The read in progress is interrupted, the queued ones fail with a
+    // broken promise.
+    void _stopReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        if (!_reader.joinable())
+            return;
+        _condition.notify_one();
+        _report->interrupt();
+        _reader.join();
+        _reads.clear();
+        _notifier.notify();
+    }
+};
+}
+
+void export_SpikeStream()
+{
+    class_<PendingSpikes>("PendingSpikes", no_init)
+        .def("ready", &PendingSpikes::ready)
+        .def("get", &PendingSpikes::get);
+
+    class_<SpikeStream, boost::noncopyable>("SpikeStream",
+                                            init<std::string>(
+                                                (arg("uri") = "monsteer://")))
+        .def("read", &SpikeStream::read, arg("min"))
+        .def("readUntil", &SpikeStream::readUntil, arg("max"))
+        .def("readUntilAsync", &SpikeStream::readUntilAsync, arg("max"))
+        .def("fileno", &SpikeStream::fileno)
+        .def("getCurrentTime", &SpikeStream::getCurrentTime)
+        .def("getEndTime", &SpikeStream::getEndTime)
+        .def("getState", &SpikeStream::getState)
+        .def("interrupt", &SpikeStream::interrupt)
+        .def("close", &SpikeStream::close);
+}
@@ -0,0 +1,224 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <boost/python.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/python/stl_iterator.hpp>
+
+#include "allowThreads.h"
+#include "cells.h"
+#include "stimulusBatch.h"
+
+#include "monsteer/steering/musicMessage.h"
+#include "monsteer/steering/stimulusBatch.h"
+#include "monsteer/steering/stimulusParameters.h"
+
+using namespace monsteer;
+using namespace boost::python;
+
+namespace
+{
+bool _isNumber(const object& value)
+{
+    // NumPy arrays are numbers for PyNumber_Check
+    PyObject* object = value.ptr();
+    return !PyBool_Check(object) && !PySequence_Check(object) &&
+           PyNumber_Check(object);
+}
+
+std::string _getModel(object model)
+{
+    if (!extract<std::string>(model).check() &&
+        PyObject_HasAttrString(model.ptr(), "__getitem__"))
+    {
+        model = model[0];
+    }
+    // SLILiteral from PyNEST
+    if (PyObject_HasAttrString(model.ptr(), "name"))
+        model = model.attr("name");
+    return extract<std::string>(str(model));
+}
+
+// Compiles a parameter dictionary as the ones passed to injectStimulus, or
+// a model name. The numeric parameters are stored as doubles, the others as
+// JSON encoded with json_encoder.
+boost::shared_ptr<StimulusParameters> StimulusParameters_init(
+    const object& parameters, const object& jsonEncoder)
+{
+    const extract<std::string> model(parameters);
+    if (model.check())
+        return boost::make_shared<StimulusParameters>(model());
+
+    const dict source(parameters);
+    if (!source.has_key("model"))
+        throw std::runtime_error("Missing stimulus model");
+    auto result = boost::make_shared<StimulusParameters>(
+        _getModel(source["model"]));
+
+    dict others;
+    const list items = source.items();
+    for (Py_ssize_t i = 0; i != len(items); ++i)
+    {
+        const object name = items[i][0];
+        const object value = items[i][1];
+        if (name == "model")
+            continue;
+        if (_isNumber(value))
+        {
+            // PyFloat_AsDouble also converts the NumPy scalars
+            const double number = PyFloat_AsDouble(value.ptr());
+            if (PyErr_Occurred())
+                throw_error_already_set();
+            result->set(extract<std::string>(name), number);
+        }
+        else
+            others[name] = value;
+    }
+    if (len(others) != 0)
+    {
+        dict options;
+        if (!jsonEncoder.is_none())
+            options["cls"] = jsonEncoder;
+        const object dumps = import("json").attr("dumps");
+        result->setJSON(
+            extract<std::string>(dumps(*make_tuple(others), **options)));
+    }
+    return result;
+}
+
+dict StimulusParameters_getParameters(const StimulusParameters& parameters)
+{
+    dict result;
+    const Strings& names = parameters.getNames();
+    const std::vector<double>& values = parameters.getValues();
+    for (size_t i = 0; i != names.size(); ++i)
+        result[names[i]] = values[i];
+    return result;
+}
+
+void StimulusBatch_injectStimulus(StimulusBatch& batch,
+                                  const StimulusParameters& parameters,
+                                  const object& cells)
+{
+    const brion::uint32_ts ids = getCells(cells);
+    AllowThreads allowThreads;
+    batch.injectStimulus(parameters, ids);
+}
+
+void StimulusBatch_injectMultipleStimuli(StimulusBatch& batch,
+                                         const StimulusParameters& parameters,
+                                         const object& cells)
+{
+    const brion::uint32_ts ids = getCells(cells);
+    AllowThreads allowThreads;
+    batch.injectMultipleStimuli(parameters, ids);
+}
+
+// The steering message of the batch as forwarded by music_proxy to Nesteer
+std::string StimulusBatch_toBase64(const StimulusBatch& batch)
+{
+    return batch.getMessage().toBase64();
+}
+
+void StimulusBatch_injectStimuli(StimulusBatch& batch,
+                                 const object& injections, const bool multiple)
+{
+    addInjections(batch, injections, multiple);
+}
+}
+
+void addInjections(StimulusBatch& batch, const object& injections,
+                   const bool multiple)
+{
+    struct Injection
+    {
+        const StimulusParameters* parameters;
+        brion::uint32_ts cells;
+        double time;
+    };
+
+    // The parameter objects are kept referenced while the GIL is released.
+    std::vector<object> references;
+    std::vector<Injection> requests;
+    stl_input_iterator<object> i(injections), end;
+    for (; i != end; ++i)
+    {
+        const object injection = *i;
+        const object parameters = injection[0];
+        references.push_back(parameters);
+        const StimulusParameters& compiled =
+            extract<const StimulusParameters&>(parameters);
+        requests.push_back(Injection{&compiled, getCells(injection[1]),
+                                     len(injection) > 2
+                                         ? extract<double>(injection[2])()
+                                         : compiled.getTime()});
+    }
+
+    AllowThreads allowThreads;
+    for (const Injection& request : requests)
+    {
+        const StimulusParameters* parameters = request.parameters;
+        StimulusParameters scheduled("");
+        if (request.time != parameters->getTime())
+        {
+            scheduled = *parameters;
+            scheduled.setTime(request.time);
+            parameters = &scheduled;
+        }
+        if (multiple)
+            batch.injectMultipleStimuli(*parameters, request.cells);
+        else
+            batch.injectStimulus(*parameters, request.cells);
+    }
+}
+
+void export_StimulusBatch()
+{
+    class_<StimulusParameters, boost::shared_ptr<StimulusParameters>>(
+        "StimulusParameters", no_init)
+        .def("__init__", make_constructor(StimulusParameters_init,
+                                          default_call_policies(),
+                                          (arg("parameters"),
+                                           arg("json_encoder") = object())))
+        .def("getModel", &StimulusParameters::getModel,
+             return_value_policy<copy_const_reference>())
+        .def("set", &StimulusParameters::set, (arg("name"), arg("value")))
+        .def("get", &StimulusParameters::get, arg("name"))
+        .def("getParameters", StimulusParameters_getParameters)
+        .def("getJSON", &StimulusParameters::getJSON,
+             return_value_policy<copy_const_reference>())
+        .def("setJSON", &StimulusParameters::setJSON, arg("json"))
+        .def("setTime", &StimulusParameters::setTime, arg("timestamp"))
+        .def("getTime", &StimulusParameters::getTime)
+        .def("setTemplate", &StimulusParameters::setTemplate,
+             arg("template_id"))
+        .def("getTemplate", &StimulusParameters::getTemplate);
+
+    class_<StimulusBatch, boost::noncopyable>("StimulusBatch")
+        .def("injectStimulus", StimulusBatch_injectStimulus,
+             (arg("parameters"), arg("cells")))
+        .def("injectMultipleStimuli", StimulusBatch_injectMultipleStimuli,
+             (arg("parameters"), arg("cells")))
+        .def("injectStimuli", StimulusBatch_injectStimuli,
+             (arg("injections"), arg("multiple") = false))
+        .def("getSize", &StimulusBatch::getSize)
+        .def("__len__", &StimulusBatch::getSize)
+        .def("empty", &StimulusBatch::empty)
+        .def("clear", &StimulusBatch::clear)
+        .def("toBase64", StimulusBatch_toBase64);
+}
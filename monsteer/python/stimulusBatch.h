@@ -0,0 +1,35 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_BINDING_STIMULUSBATCH_H
+#define MONSTEER_BINDING_STIMULUSBATCH_H
+
+#include <boost/python/object_fwd.hpp>
+#include <monsteer/types.h>
+
+/**
+ * Add the injections given as a sequence of (StimulusParameters, cells) or
+ * (StimulusParameters, cells, time) tuples to a batch. The Python objects
+ * are read first and the injections are encoded with the GIL released.
+ */
+void addInjections(monsteer::StimulusBatch& batch,
+                   const boost::python::object& injections, bool multiple);
+
+void export_StimulusBatch();
+
+#endif
@@ -33,9 +33,12 @@
 
 #include <QTimer>
 
+#include <chrono>
+
 namespace
 {
 const monsteer::URI pluginURI(MONSTEER_NEST_SIMULATOR_PLUGIN_SCHEME + "://");
+const int statusTimeout = 500; // ms
 }
 
 namespace monsteer
@@ -139,6 +142,7 @@ struct SteeringWidget::Impl
         {
             _simulator = new monsteer::Simulator(pluginURI);
             _ui.btnPlayPauseSimulation->setEnabled(true);
+            _updatePlaybackState();
         }
         catch (const std::exception& error)
         {
@@ -149,6 +153,21 @@ struct SteeringWidget::Impl
     }
 
     void disconnectISC() { delete _simulator; }
+    // Show the actual playback state instead of assuming the simulation is
+    // playing. The simulation may not be running yet, so do not wait long.
+    void _updatePlaybackState()
+    {
+        auto status = _simulator->getStatus();
+        if (status.wait_for(std::chrono::milliseconds(statusTimeout)) !=
+            std::future_status::ready)
+        {
+            return;
+        }
+        _playing = status.get().state != monsteer::steering::State::PAUSE;
+        _ui.btnPlayPauseSimulation->setText(
+            _playing ? "Pause simulation" : "Resume simulation");
+    }
+
     void onSelection(::lexis::data::ConstSelectedIDsPtr event)
     {
         emit _steeringWidget->updateCellIdsTextBox(event->getIdsVector());
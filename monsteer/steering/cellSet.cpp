@@ -0,0 +1,139 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "cellSet.h"
+
+#include <stdexcept>
+
+namespace monsteer
+{
+namespace steering
+{
+namespace
+{
+const size_t RANGE_WORDS = 3;
+const size_t WORD_BITS = 32;
+
+// Returns the end of the run of equally spaced ids starting at begin.
+size_t _runEnd(const uint32_t* cells, const size_t count, const size_t begin)
+{
+    if (begin + 1 >= count)
+        return count;
+    const uint32_t stride = cells[begin + 1] - cells[begin];
+    size_t end = begin + 2;
+    while (end < count && cells[end] - cells[end - 1] == stride)
+        ++end;
+    return end;
+}
+
+bool _isIncreasing(const uint32_t* cells, const size_t count)
+{
+    for (size_t i = 1; i < count; ++i)
+        if (cells[i] <= cells[i - 1])
+            return false;
+    return true;
+}
+}
+
+CellEncoding encodeCells(const uint32_t* cells, const size_t count,
+                         brion::uint32_ts& encoded)
+{
+    encoded.clear();
+    if (count == 0 || !_isIncreasing(cells, count))
+    {
+        encoded.assign(cells, cells + count);
+        return CellEncoding::LIST;
+    }
+
+    size_t ranges = 0;
+    for (size_t i = 0; i < count; i = _runEnd(cells, count, i))
+        ++ranges;
+
+    const size_t listSize = count;
+    const size_t rangesSize = ranges * RANGE_WORDS;
+    const size_t span = size_t(cells[count - 1]) - cells[0] + 1;
+    const size_t bitmapSize = 1 + (span + WORD_BITS - 1) / WORD_BITS;
+
+    if (listSize <= rangesSize && listSize <= bitmapSize)
+    {
+        encoded.assign(cells, cells + count);
+        return CellEncoding::LIST;
+    }
+
+    if (rangesSize <= bitmapSize)
+    {
+        encoded.reserve(rangesSize);
+        for (size_t i = 0; i < count;)
+        {
+            const size_t end = _runEnd(cells, count, i);
+            const uint32_t stride = end - i > 1 ? cells[i + 1] - cells[i] : 1;
+            encoded.push_back(cells[i]);
+            encoded.push_back(uint32_t(end - i));
+            encoded.push_back(stride);
+            i = end;
+        }
+        return CellEncoding::RANGES;
+    }
+
+    const uint32_t first = cells[0];
+    encoded.resize(bitmapSize, 0);
+    encoded[0] = first;
+    for (size_t i = 0; i != count; ++i)
+    {
+        const size_t bit = cells[i] - first;
+        encoded[1 + bit / WORD_BITS] |= 1u << (bit % WORD_BITS);
+    }
+    return CellEncoding::BITMAP;
+}
+
+brion::uint32_ts decodeCells(const CellEncoding encoding, const uint32_t* data,
+                             const size_t size)
+{
+    brion::uint32_ts cells;
+    switch (encoding)
+    {
+    case CellEncoding::LIST:
+        cells.assign(data, data + size);
+        break;
+    case CellEncoding::RANGES:
+    {
+        if (size % RANGE_WORDS != 0)
+            throw std::runtime_error("Malformed cell ranges");
+        for (size_t i = 0; i != size; i += RANGE_WORDS)
+            for (uint32_t j = 0; j != data[i + 1]; ++j)
+                cells.push_back(data[i] + j * data[i + 2]);
+        break;
+    }
+    case CellEncoding::BITMAP:
+    {
+        if (size == 0)
+            throw std::runtime_error("Malformed cell bitmap");
+        for (size_t word = 1; word != size; ++word)
+            for (size_t bit = 0; bit != WORD_BITS; ++bit)
+                if (data[word] & (1u << bit))
+                    cells.push_back(
+                        uint32_t(data[0] + (word - 1) * WORD_BITS + bit));
+        break;
+    }
+    default:
+        throw std::runtime_error("Unknown cell encoding");
+    }
+    return cells;
+}
+}
+}
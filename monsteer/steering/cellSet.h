@@ -0,0 +1,53 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_STEERING_CELLSET_H
+#define MONSTEER_STEERING_CELLSET_H
+
+#include <monsteer/steering/stimulus.h> // CellEncoding
+#include <monsteer/types.h>
+
+namespace monsteer
+{
+namespace steering
+{
+/**
+ * Encode a list of cell ids with the smallest CellEncoding.
+ *
+ * Lists that are not strictly increasing are always encoded as LIST, so
+ * decoding returns exactly the input. Otherwise the sizes of the RANGES and
+ * BITMAP encodings are computed and the smallest one is used, so contiguous
+ * or strided blocks of any size take a few words.
+ *
+ * @param cells the cell ids.
+ * @param count the number of cell ids.
+ * @param encoded the encoded words, replaced.
+ * @return the encoding used.
+ */
+CellEncoding encodeCells(const uint32_t* cells, size_t count,
+                         brion::uint32_ts& encoded);
+
+/**
+ * Decode the cell ids encoded by encodeCells.
+ * @throw std::runtime_error if the data is malformed.
+ */
+brion::uint32_ts decodeCells(CellEncoding encoding, const uint32_t* data,
+                             size_t size);
+}
+}
+#endif
@@ -0,0 +1,307 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "controller.h"
+
+#include <brion/spikeReport.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace monsteer
+{
+class Controller::Impl
+{
+public:
+    Impl(const URI& spikes, Simulator& simulator_, const float window_,
+         const Policy& policy_)
+        : report(spikes, brion::MODE_READ)
+        , simulator(simulator_)
+        , window(window_)
+        , policy(policy_)
+    {
+        if (!(window > 0))
+            throw std::runtime_error("Controller window must be positive");
+    }
+
+    ~Impl() { stop(); }
+    void start()
+    {
+        if (started)
+            return;
+        started = true;
+        running = true;
+        reader = std::thread([this] { _read(); });
+        thread = std::thread([this] { _run(); });
+        acknowledger = std::thread([this] { _acknowledge(); });
+    }
+
+    void stop()
+    {
+        if (!thread.joinable())
+            return;
+        stopping = true;
+        report.interrupt();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            condition.notify_all();
+        }
+        _join();
+    }
+
+    void wait()
+    {
+        _join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    brion::SpikeReport report;
+    Simulator& simulator;
+    const float window;
+    const Policy policy;
+
+    std::thread reader;
+    std::thread thread;
+    std::thread acknowledger;
+    bool started = false;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopping{false};
+    std::exception_ptr error;
+
+    mutable std::mutex mutex;
+    Histogram latencies;
+    uint64_t windows = 0;
+
+private:
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Window
+    {
+        brion::Spikes spikes;
+        float start;
+        float end;
+        Clock::time_point received;
+    };
+
+    struct Request
+    {
+        std::future<double> acknowledged;
+        Clock::time_point received; // Of the window
+    };
+
+    // Guarded by mutex
+    std::condition_variable condition;
+    std::deque<Window> windowQueue;
+    std::deque<Request> requests;
+    bool readerDone = false;
+    bool policyDone = false;
+
+    void _join()
+    {
+        for (auto worker : {&reader, &thread, &acknowledger})
+        {
+            if (worker->joinable())
+                worker->join();
+        }
+    }
+
+    // Records the first error and ends the loop.
+    void _fail(std::exception_ptr exception)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+            return;
+        error = exception;
+        stopping = true;
+        report.interrupt();
+        condition.notify_all();
+    }
+
+    template <typename T>
+    void _push(std::deque<T>& queue, T&& item)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(item));
+        condition.notify_all();
+    }
+
+    // @return false when the queue is empty and will not grow.
+    template <typename T>
+    bool _pop(std::deque<T>& queue, const bool& done, T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock,
+                       [&] { return !queue.empty() || done || stopping; });
+        if (queue.empty() || stopping)
+            return false;
+        item = std::move(queue.front());
+        queue.pop_front();
+        return true;
+    }
+
+    void _finish(bool& done)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        condition.notify_all();
+    }
+
+    void _record(const Clock::time_point& received)
+    {
+        const auto latency =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - received);
+        std::lock_guard<std::mutex> lock(mutex);
+        latencies.record(latency.count());
+    }
+
+    // The windows are timestamped as soon as the stream reaches their end.
+    void _read()
+    {
+        try
+        {
+            float start = report.getCurrentTime();
+            while (!stopping &&
+                   report.getState() == brion::SpikeReport::State::ok)
+            {
+                const float end = start + window;
+                brion::Spikes spikes = report.readUntil(end).get();
+                _push(windowQueue, Window{std::move(spikes), start, end,
+                                       Clock::now()});
+                start = end;
+            }
+        }
+        catch (...)
+        {
+            // Interrupted reads throw, they are not an error.
+            _fail(std::current_exception());
+        }
+        _finish(readerDone);
+    }
+
+    void _run()
+    {
+        Window next;
+        while (_pop(windowQueue, readerDone, next))
+        {
+            Request request;
+            try
+            {
+                request.acknowledged =
+                    policy(next.spikes, next.start, next.end, simulator);
+            }
+            catch (...)
+            {
+                _fail(std::current_exception());
+                break;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++windows;
+            }
+
+            if (!request.acknowledged.valid())
+            {
+                _record(next.received);
+                continue;
+            }
+            request.received = next.received;
+            _push(requests, std::move(request));
+        }
+        _finish(policyDone);
+    }
+
+    // Waits for the acknowledgements in order, they are received in the
+    // order of the requests.
+    void _acknowledge()
+    {
+        Request request;
+        while (_pop(requests, policyDone, request))
+        {
+            // The wait is split to notice stop(), it returns as soon as the
+            // acknowledgement is received.
+            while (!stopping &&
+                   request.acknowledged.wait_for(std::chrono::milliseconds(
+                       10)) != std::future_status::ready)
+            {
+            }
+            if (stopping)
+                break;
+            try
+            {
+                request.acknowledged.get();
+                _record(request.received);
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+        running = false;
+    }
+};
+
+Controller::Controller(const URI& spikes, Simulator& simulator,
+                       const float window, const Policy& policy)
+    : _impl(new Controller::Impl(spikes, simulator, window, policy))
+{
+}
+
+Controller::~Controller()
+{
+    delete _impl;
+}
+
+void Controller::start()
+{
+    _impl->start();
+}
+
+void Controller::stop()
+{
+    _impl->stop();
+}
+
+void Controller::wait()
+{
+    _impl->wait();
+}
+
+bool Controller::isRunning() const
+{
+    return _impl->running;
+}
+
+uint64_t Controller::getWindowCount() const
+{
+    std::lock_guard<std::mutex> lock(_impl->mutex);
+    return _impl->windows;
+}
+
+Histogram Controller::getLatencies() const
+{
+    std::lock_guard<std::mutex> lock(_impl->mutex);
+    return _impl->latencies;
+}
+}
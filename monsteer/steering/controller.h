@@ -0,0 +1,126 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_CONTROLLER_H
+#define MONSTEER_CONTROLLER_H
+
+#include <monsteer/histogram.h>
+#include <monsteer/types.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <functional>
+#include <future>
+
+namespace monsteer
+{
+/**
+ * Closed-loop steering of a simulation from its own spikes.
+ *
+ * The controller reads a streaming spike report in consecutive windows of
+ * simulation time. As soon as the stream has reached the end of a window, a
+ * policy is called with its spikes to steer the simulation through a
+ * Simulator. Windows are processed in order on a dedicated thread, so the
+ * policy does not need to be thread safe, but it should not wait for the
+ * acknowledgements of its requests: it returns the acknowledgement of its
+ * last request instead.
+ *
+ * The loop latency of each window is recorded in microseconds, from the
+ * moment the stream reaches the end of the window to the acknowledgement of
+ * the request returned by the policy, or to the return of the policy if it
+ * made no request. The stream is read on its own thread, so the time that a
+ * window waits for a slower policy is part of its latency. Requests that
+ * fail are not recorded.
+ *
+ * start(), stop() and wait() must be called from the same thread.
+ *
+ * @version 0.8
+ */
+class Controller : public boost::noncopyable
+{
+public:
+    /**
+     * Called for every window with its spikes, sorted by time, its start and
+     * end times in milliseconds and the steered simulator. The last window
+     * ends with the stream and includes all its remaining spikes.
+     *
+     * Returns the future of the last request made for the window, e.g. of
+     * Simulator::submit(), or a default constructed future if there is none.
+     */
+    typedef std::function<std::future<double>(const brion::Spikes& spikes,
+                                              float start, float end,
+                                              Simulator& simulator)>
+        Policy;
+
+    /**
+     * @param spikes URI of the streaming spike report, e.g. monsteer://
+     * @param simulator the simulator steered by the policy, which must
+     *        outlive the controller.
+     * @param window duration of the windows in milliseconds.
+     * @param policy the function called for every window.
+     * @throw std::runtime_error if the spike report cannot be opened or the
+     *        window is not positive.
+     * @version 0.8
+     */
+    Controller(const URI& spikes, Simulator& simulator, float window,
+               const Policy& policy);
+
+    /** Stop the loop if it is running. @version 0.8 */
+    ~Controller();
+
+    /**
+     * Start processing windows on the controller thread. A controller runs
+     * only once, later calls have no effect.
+     * @version 0.8
+     */
+    void start();
+
+    /**
+     * Interrupt the loop and wait for its threads. The policy is not called
+     * for the windows not processed yet and the pending acknowledgements are
+     * not recorded.
+     * @version 0.8
+     */
+    void stop();
+
+    /**
+     * Wait until the end of the spike stream or a call to stop().
+     * @throw the exception of the policy or spike report that ended the
+     *        loop, if any.
+     * @version 0.8
+     */
+    void wait();
+
+    /** @return true if the loop has been started and has not ended. */
+    bool isRunning() const;
+
+    /** @return the number of windows processed so far. @version 0.8 */
+    uint64_t getWindowCount() const;
+
+    /**
+     * @return a copy of the loop latencies recorded so far, in microseconds.
+     * @version 0.8
+     */
+    Histogram getLatencies() const;
+
+private:
+    class Impl;
+    Impl* _impl;
+};
+}
+#endif
@@ -6,17 +6,31 @@
 
 include(zerobufGenerateCxx)
 zerobuf_generate_cxx(MONSTEER_FBS ${CMAKE_CURRENT_BINARY_DIR}/steering
-  steering/playbackState.fbs steering/stimulus.fbs)
+  steering/ensemble.fbs steering/playbackState.fbs steering/reply.fbs
+  steering/stimulus.fbs steering/telemetry.fbs)
 
 list(APPEND MONSTEER_PUBLIC_HEADERS
    ${MONSTEER_FBS_HEADERS}
+   steering/cellSet.h
+   steering/controller.h
+   steering/musicMessage.h
    steering/simulator.h
-   steering/simulatorPlugin.h)
+   steering/simulatorPlugin.h
+   steering/stimulusBatch.h
+   steering/stimulusParameters.h)
 
 list(APPEND MONSTEER_HEADERS
+  steering/notifier.h
+  steering/plugin/nestConnection.h
   steering/plugin/nestSimulator.h)
 
 list(APPEND MONSTEER_SOURCES
   ${MONSTEER_FBS_SOURCES}
+  steering/cellSet.cpp
+  steering/controller.cpp
+  steering/musicMessage.cpp
   steering/simulator.cpp
+  steering/stimulusBatch.cpp
+  steering/stimulusParameters.cpp
+  steering/plugin/nestConnection.cpp
   steering/plugin/nestSimulator.cpp)
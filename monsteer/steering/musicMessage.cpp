@@ -0,0 +1,486 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "musicMessage.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace monsteer
+{
+namespace steering
+{
+namespace
+{
+const size_t HEADER_WORDS = 4;
+const size_t RECORD_HEADER_WORDS = 2;
+const size_t COUNT_WORD = 2;
+
+const char* const base64Chars =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+size_t _toWords(const size_t bytes)
+{
+    return (bytes + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+}
+
+std::string _encodeBase64(const uint8_t* data, const size_t size)
+{
+    std::string out;
+    out.reserve((size + 2) / 3 * 4);
+
+    size_t i = 0;
+    for (; i + 2 < size; i += 3)
+    {
+        const uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        out.push_back(base64Chars[(v >> 18) & 0x3f]);
+        out.push_back(base64Chars[(v >> 12) & 0x3f]);
+        out.push_back(base64Chars[(v >> 6) & 0x3f]);
+        out.push_back(base64Chars[v & 0x3f]);
+    }
+    if (i < size)
+    {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < size)
+            v |= data[i + 1] << 8;
+        out.push_back(base64Chars[(v >> 18) & 0x3f]);
+        out.push_back(base64Chars[(v >> 12) & 0x3f]);
+        out.push_back(i + 1 < size ? base64Chars[(v >> 6) & 0x3f] : '=');
+        out.push_back('=');
+    }
+    return out;
+}
+
+std::vector<uint32_t> _decodeBase64(const std::string& text)
+{
+    int8_t lookup[256];
+    memset(lookup, -1, sizeof(lookup));
+    for (int8_t i = 0; i < 64; ++i)
+        lookup[uint8_t(base64Chars[i])] = i;
+
+    std::vector<uint32_t> words(_toWords(text.size() * 3 / 4 + 3));
+    uint8_t* out = reinterpret_cast<uint8_t*>(words.data());
+    size_t size = 0;
+    uint32_t buffer = 0;
+    int bits = 0;
+    for (const char c : text)
+    {
+        if (c == '=')
+            break;
+        const int8_t value = lookup[uint8_t(c)];
+        if (value < 0)
+            throw std::runtime_error("Invalid character in steering message");
+        buffer = (buffer << 6) | uint32_t(value);
+        bits += 6;
+        if (bits >= 8)
+        {
+            bits -= 8;
+            out[size++] = uint8_t(buffer >> bits);
+        }
+    }
+    words.resize(_toWords(size));
+    return words;
+}
+}
+
+MusicMessageWriter::MusicMessageWriter()
+{
+    clear();
+}
+
+void MusicMessageWriter::addStimulusInjection(const std::string& jsonParameters,
+                                              const uint32_t* cells,
+                                              const size_t cellCount,
+                                              const bool multiple)
+{
+    const size_t start = _beginRecord(MusicMessageRecord::stimulusInjection);
+    _words.push_back(multiple ? 1 : 0);
+    _words.push_back(uint32_t(jsonParameters.size()));
+    _words.push_back(uint32_t(cellCount));
+    _appendBytes(jsonParameters.data(), jsonParameters.size());
+    _words.insert(_words.end(), cells, cells + cellCount);
+    _endRecord(start);
+}
+
+void MusicMessageWriter::addStimulusInjection(
+    const CompactStimulusInjectionRecord& record)
+{
+    const size_t start =
+        _beginRecord(MusicMessageRecord::compactStimulusInjection);
+    _words.push_back(record.multiple ? 1 : 0);
+    _words.push_back(uint32_t(record.cellEncoding));
+    _words.push_back(uint32_t(record.messageID));
+    _words.push_back(uint32_t(record.messageID >> 32));
+    _words.push_back(uint32_t(record.templateID));
+    _words.push_back(uint32_t(record.templateID >> 32));
+    _words.push_back(uint32_t(record.model.size()));
+    _words.push_back(uint32_t(record.parameterNames.size()));
+    _words.push_back(uint32_t(record.parameterValues.size()));
+    _words.push_back(uint32_t(record.jsonParameters.size()));
+    _words.push_back(uint32_t(record.cellWords));
+    _appendBytes(&record.time, sizeof(double));
+    _appendBytes(record.model.data(), record.model.size());
+    _appendBytes(record.parameterNames.data(), record.parameterNames.size());
+    _appendBytes(record.parameterValues.data(),
+                 record.parameterValues.size() * sizeof(double));
+    _appendBytes(record.jsonParameters.data(), record.jsonParameters.size());
+    _words.insert(_words.end(), record.cells, record.cells + record.cellWords);
+    _endRecord(start);
+}
+
+void MusicMessageWriter::addStimulusUpdate(const StimulusUpdateRecord& record)
+{
+    const size_t start = _beginRecord(MusicMessageRecord::stimulusUpdate);
+    _words.push_back(uint32_t(record.stimulusID));
+    _words.push_back(uint32_t(record.stimulusID >> 32));
+    _words.push_back(uint32_t(record.parameterNames.size()));
+    _words.push_back(uint32_t(record.parameterValues.size()));
+    _words.push_back(uint32_t(record.jsonParameters.size()));
+    _appendBytes(record.parameterNames.data(), record.parameterNames.size());
+    _appendBytes(record.jsonParameters.data(), record.jsonParameters.size());
+    _appendBytes(record.parameterValues.data(),
+                 record.parameterValues.size() * sizeof(double));
+    _endRecord(start);
+}
+
+void MusicMessageWriter::addStimulusRemoval(const uint64_t stimulusID)
+{
+    const size_t start = _beginRecord(MusicMessageRecord::stimulusRemoval);
+    _words.push_back(uint32_t(stimulusID));
+    _words.push_back(uint32_t(stimulusID >> 32));
+    _endRecord(start);
+}
+
+void MusicMessageWriter::addStimulusTemplate(
+    const StimulusTemplateRecord& record)
+{
+    const size_t start = _beginRecord(MusicMessageRecord::stimulusTemplate);
+    _words.push_back(uint32_t(record.templateID));
+    _words.push_back(uint32_t(record.templateID >> 32));
+    _words.push_back(uint32_t(record.model.size()));
+    _words.push_back(uint32_t(record.parameterNames.size()));
+    _words.push_back(uint32_t(record.parameterValues.size()));
+    _words.push_back(uint32_t(record.jsonParameters.size()));
+    _appendBytes(record.model.data(), record.model.size());
+    _appendBytes(record.parameterNames.data(), record.parameterNames.size());
+    _appendBytes(record.jsonParameters.data(), record.jsonParameters.size());
+    _appendBytes(record.parameterValues.data(),
+                 record.parameterValues.size() * sizeof(double));
+    _endRecord(start);
+}
+
+void MusicMessageWriter::addRecords(const void* data, const size_t size)
+{
+    if (size % sizeof(uint32_t) != 0)
+        throw std::runtime_error("Truncated steering message");
+
+    // Validates the header and the record sizes.
+    MusicMessageReader reader(data, size);
+    uint32_t count = 0;
+    while (reader.next())
+        ++count;
+
+    const uint32_t* words = static_cast<const uint32_t*>(data);
+    _words.insert(_words.end(), words + HEADER_WORDS,
+                  words + size / sizeof(uint32_t));
+    _words[COUNT_WORD] += count;
+}
+
+void MusicMessageWriter::addTiming(const double receiveTime,
+                                   const double sendTime,
+                                   const double simulationTime)
+{
+    const size_t start = _beginRecord(MusicMessageRecord::timing);
+    const double times[] = {receiveTime, sendTime, simulationTime};
+    _appendBytes(times, sizeof(times));
+    _endRecord(start);
+}
+
+size_t MusicMessageWriter::getRecordCount() const
+{
+    return _words[COUNT_WORD];
+}
+
+std::string MusicMessageWriter::toBase64() const
+{
+    return _encodeBase64(reinterpret_cast<const uint8_t*>(getData()),
+                         getSize());
+}
+
+void MusicMessageWriter::clear()
+{
+    _words = {MUSIC_MESSAGE_MAGIC, MUSIC_MESSAGE_VERSION, 0, 0};
+}
+
+size_t MusicMessageWriter::_beginRecord(const MusicMessageRecord type)
+{
+    const size_t start = _words.size();
+    _words.push_back(uint32_t(type));
+    _words.push_back(0);
+    ++_words[COUNT_WORD];
+    return start;
+}
+
+void MusicMessageWriter::_endRecord(const size_t recordStart)
+{
+    const size_t payloadWords =
+        _words.size() - recordStart - RECORD_HEADER_WORDS;
+    _words[recordStart + 1] = uint32_t(payloadWords * sizeof(uint32_t));
+}
+
+void MusicMessageWriter::_appendBytes(const void* data, const size_t size)
+{
+    const size_t start = _words.size();
+    _words.resize(start + _toWords(size), 0);
+    if (size > 0)
+        memcpy(&_words[start], data, size);
+}
+
+MusicMessageReader::MusicMessageReader(const std::string& base64)
+    : _words(_decodeBase64(base64))
+    , _current(0)
+    , _next(HEADER_WORDS)
+{
+    _checkHeader();
+}
+
+MusicMessageReader::MusicMessageReader(const void* data, const size_t size)
+    : _words(_toWords(size), 0)
+    , _current(0)
+    , _next(HEADER_WORDS)
+{
+    if (size > 0)
+        memcpy(_words.data(), data, size);
+    _checkHeader();
+}
+
+size_t MusicMessageReader::getRecordCount() const
+{
+    return _words[COUNT_WORD];
+}
+
+bool MusicMessageReader::next()
+{
+    if (_next >= _words.size())
+        return false;
+    if (_next + RECORD_HEADER_WORDS > _words.size())
+        throw std::runtime_error("Truncated steering message record");
+
+    const size_t payloadWords = _toWords(_words[_next + 1]);
+    if (_next + RECORD_HEADER_WORDS + payloadWords > _words.size())
+        throw std::runtime_error("Truncated steering message record");
+
+    _current = _next;
+    _next += RECORD_HEADER_WORDS + payloadWords;
+    return true;
+}
+
+MusicMessageRecord MusicMessageReader::getType() const
+{
+    if (_current == 0)
+        throw std::runtime_error("No current steering message record");
+    return MusicMessageRecord(_words[_current]);
+}
+
+StimulusInjectionRecord MusicMessageReader::getStimulusInjection() const
+{
+    if (getType() != MusicMessageRecord::stimulusInjection)
+        throw std::runtime_error("Not a stimulus injection record");
+
+    const size_t payloadWords = _toWords(_words[_current + 1]);
+    if (payloadWords < 3)
+        throw std::runtime_error("Malformed stimulus injection record");
+
+    const uint32_t* payload = &_words[_current + RECORD_HEADER_WORDS];
+    const size_t paramsWords = _toWords(payload[1]);
+    const size_t cellCount = payload[2];
+    if (3 + paramsWords + cellCount > payloadWords)
+        throw std::runtime_error("Malformed stimulus injection record");
+
+    StimulusInjectionRecord record;
+    record.multiple = payload[0] & 1;
+    record.jsonParameters.assign(reinterpret_cast<const char*>(payload + 3),
+                                 payload[1]);
+    record.cells = payload + 3 + paramsWords;
+    record.cellCount = cellCount;
+    return record;
+}
+
+CompactStimulusInjectionRecord
+    MusicMessageReader::getCompactStimulusInjection() const
+{
+    if (getType() != MusicMessageRecord::compactStimulusInjection)
+        throw std::runtime_error("Not a compact stimulus injection record");
+
+    const size_t fixedWords = 13;
+    const size_t payloadWords = _toWords(_words[_current + 1]);
+    if (payloadWords < fixedWords)
+        throw std::runtime_error("Malformed stimulus injection record");
+
+    const uint32_t* payload = &_words[_current + RECORD_HEADER_WORDS];
+    const size_t modelSize = payload[6];
+    const size_t namesSize = payload[7];
+    const size_t valueCount = payload[8];
+    const size_t jsonSize = payload[9];
+    const size_t cellWords = payload[10];
+    const size_t modelWords = _toWords(modelSize);
+    const size_t namesWords = _toWords(namesSize);
+    const size_t valuesWords = _toWords(valueCount * sizeof(double));
+    const size_t jsonWords = _toWords(jsonSize);
+    if (fixedWords + modelWords + namesWords + valuesWords + jsonWords +
+            cellWords >
+        payloadWords)
+    {
+        throw std::runtime_error("Malformed stimulus injection record");
+    }
+
+    const char* data = reinterpret_cast<const char*>(payload + fixedWords);
+    CompactStimulusInjectionRecord record;
+    record.multiple = payload[0] & 1;
+    record.cellEncoding = CellEncoding(payload[1]);
+    record.messageID = uint64_t(payload[2]) | (uint64_t(payload[3]) << 32);
+    record.templateID = uint64_t(payload[4]) | (uint64_t(payload[5]) << 32);
+    memcpy(&record.time, payload + 11, sizeof(double));
+    record.model.assign(data, modelSize);
+    data += modelWords * sizeof(uint32_t);
+    record.parameterNames.assign(data, namesSize);
+    data += namesWords * sizeof(uint32_t);
+    // Copied because the values are not necessarily aligned to 8 bytes.
+    record.parameterValues.resize(valueCount);
+    if (valueCount > 0)
+        memcpy(record.parameterValues.data(), data,
+               valueCount * sizeof(double));
+    data += valuesWords * sizeof(uint32_t);
+    record.jsonParameters.assign(data, jsonSize);
+    data += jsonWords * sizeof(uint32_t);
+    record.cells = reinterpret_cast<const uint32_t*>(data);
+    record.cellWords = cellWords;
+    return record;
+}
+
+StimulusUpdateRecord MusicMessageReader::getStimulusUpdate() const
+{
+    if (getType() != MusicMessageRecord::stimulusUpdate)
+        throw std::runtime_error("Not a stimulus update record");
+
+    const size_t fixedWords = 5;
+    const size_t payloadWords = _toWords(_words[_current + 1]);
+    if (payloadWords < fixedWords)
+        throw std::runtime_error("Malformed stimulus update record");
+
+    const uint32_t* payload = &_words[_current + RECORD_HEADER_WORDS];
+    const size_t namesSize = payload[2];
+    const size_t valueCount = payload[3];
+    const size_t jsonSize = payload[4];
+    const size_t namesWords = _toWords(namesSize);
+    const size_t jsonWords = _toWords(jsonSize);
+    if (fixedWords + namesWords + jsonWords +
+            _toWords(valueCount * sizeof(double)) >
+        payloadWords)
+    {
+        throw std::runtime_error("Malformed stimulus update record");
+    }
+
+    const char* data = reinterpret_cast<const char*>(payload + fixedWords);
+    StimulusUpdateRecord record;
+    record.stimulusID = uint64_t(payload[0]) | (uint64_t(payload[1]) << 32);
+    record.parameterNames.assign(data, namesSize);
+    data += namesWords * sizeof(uint32_t);
+    record.jsonParameters.assign(data, jsonSize);
+    data += jsonWords * sizeof(uint32_t);
+    record.parameterValues.resize(valueCount);
+    if (valueCount > 0)
+        memcpy(record.parameterValues.data(), data,
+               valueCount * sizeof(double));
+    return record;
+}
+
+uint64_t MusicMessageReader::getStimulusRemoval() const
+{
+    if (getType() != MusicMessageRecord::stimulusRemoval)
+        throw std::runtime_error("Not a stimulus removal record");
+    if (_toWords(_words[_current + 1]) < 2)
+        throw std::runtime_error("Malformed stimulus removal record");
+
+    const uint32_t* payload = &_words[_current + RECORD_HEADER_WORDS];
+    return uint64_t(payload[0]) | (uint64_t(payload[1]) << 32);
+}
+
+StimulusTemplateRecord MusicMessageReader::getStimulusTemplate() const
+{
+    if (getType() != MusicMessageRecord::stimulusTemplate)
+        throw std::runtime_error("Not a stimulus template record");
+
+    const size_t fixedWords = 6;
+    const size_t payloadWords = _toWords(_words[_current + 1]);
+    if (payloadWords < fixedWords)
+        throw std::runtime_error("Malformed stimulus template record");
+
+    const uint32_t* payload = &_words[_current + RECORD_HEADER_WORDS];
+    const size_t modelSize = payload[2];
+    const size_t namesSize = payload[3];
+    const size_t valueCount = payload[4];
+    const size_t jsonSize = payload[5];
+    const size_t modelWords = _toWords(modelSize);
+    const size_t namesWords = _toWords(namesSize);
+    const size_t jsonWords = _toWords(jsonSize);
+    if (fixedWords + modelWords + namesWords + jsonWords +
+            _toWords(valueCount * sizeof(double)) >
+        payloadWords)
+    {
+        throw std::runtime_error("Malformed stimulus template record");
+    }
+
+    const char* data = reinterpret_cast<const char*>(payload + fixedWords);
+    StimulusTemplateRecord record;
+    record.templateID = uint64_t(payload[0]) | (uint64_t(payload[1]) << 32);
+    record.model.assign(data, modelSize);
+    data += modelWords * sizeof(uint32_t);
+    record.parameterNames.assign(data, namesSize);
+    data += namesWords * sizeof(uint32_t);
+    record.jsonParameters.assign(data, jsonSize);
+    data += jsonWords * sizeof(uint32_t);
+    record.parameterValues.resize(valueCount);
+    if (valueCount > 0)
+        memcpy(record.parameterValues.data(), data,
+               valueCount * sizeof(double));
+    return record;
+}
+
+TimingRecord MusicMessageReader::getTiming() const
+{
+    if (getType() != MusicMessageRecord::timing)
+        throw std::runtime_error("Not a timing record");
+    if (_words[_current + 1] < sizeof(TimingRecord))
+        throw std::runtime_error("Malformed timing record");
+
+    double times[3];
+    memcpy(times, &_words[_current + RECORD_HEADER_WORDS], sizeof(times));
+    return TimingRecord{times[0], times[1], times[2]};
+}
+
+void MusicMessageReader::_checkHeader()
+{
+    if (_words.size() < HEADER_WORDS || _words[0] != MUSIC_MESSAGE_MAGIC)
+        throw std::runtime_error("Not a Monsteer steering message");
+    if (_words[1] != MUSIC_MESSAGE_VERSION)
+        throw std::runtime_error("Unsupported steering message version " +
+                                 std::to_string(_words[1]));
+}
+}
+}
@@ -0,0 +1,273 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_STEERING_MUSICMESSAGE_H
+#define MONSTEER_STEERING_MUSICMESSAGE_H
+
+#include <monsteer/steering/stimulus.h> // CellEncoding
+#include <monsteer/types.h>
+
+#include <string>
+#include <vector>
+
+namespace monsteer
+{
+namespace steering
+{
+/**
+ * Binary container for the steering requests forwarded through the MUSIC
+ * message port of the simulation.
+ *
+ * A message is a sequence of 32-bit words in host byte order:
+ * - Header: magic, version, record count, reserved.
+ * - Records: type, payload size in bytes (a multiple of 4), payload.
+ *
+ * Readers skip the records whose type they do not know, so new record types
+ * can be added without breaking older simulation scripts.
+ *
+ * Stimulus injection payload: flags (bit 0: multiple), parameters size,
+ * cell count, JSON parameters padded to 4 bytes, cell ids.
+ *
+ * Compact stimulus injection payload: flags (bit 0: multiple), cell
+ * encoding, message id and template id (low and high words), sizes of the
+ * model, parameter names, parameter values (count), JSON parameters and
+ * cells (words), onset time in milliseconds (double, 0 to apply
+ * immediately), then the model and names padded to 4 bytes, the values as
+ * doubles, the JSON padded to 4 bytes and the encoded cells (see cellSet.h).
+ *
+ * Stimulus update payload: stimulus id (low and high words), sizes of the
+ * parameter names, parameter values (count) and JSON parameters, then the
+ * names and JSON padded to 4 bytes and the values as doubles.
+ *
+ * Stimulus removal payload: stimulus id (low and high words).
+ *
+ * Stimulus template payload: template id (low and high words), sizes of the
+ * model, parameter names, parameter values (count) and JSON parameters,
+ * then the model, names and JSON padded to 4 bytes and the values as
+ * doubles. The parameters of an injection that references a template
+ * override those of the template.
+ *
+ * Timing payload: wall clock time in seconds since the epoch at which the
+ * first request of the message was received and at which the message was
+ * sent, MUSIC time in milliseconds at which the message was sent (doubles).
+ *
+ * MUSIC message ports are exposed to PyNEST as strings, so the message is
+ * transported as base64 text, see toBase64() and MusicMessageReader.
+ */
+enum class MusicMessageRecord : uint32_t
+{
+    stimulusInjection = 1,
+    timing = 2,
+    compactStimulusInjection = 3,
+    stimulusUpdate = 4,
+    stimulusRemoval = 5,
+    stimulusTemplate = 6
+};
+
+/** A stimulus injection with typed parameters and encoded cells. */
+struct CompactStimulusInjectionRecord
+{
+    uint64_t messageID;
+    uint64_t templateID; // 0 if the parameters are not based on a template
+    std::string model;
+    std::string parameterNames; // ';' separated
+    std::vector<double> parameterValues;
+    std::string jsonParameters;
+    double time; // Onset in milliseconds, 0 to apply immediately
+    bool multiple;
+    CellEncoding cellEncoding;
+    const uint32_t* cells; // Points into the reader buffer when read
+    size_t cellWords;
+};
+
+/** New parameters of a stimulus created with a handle. */
+struct StimulusUpdateRecord
+{
+    uint64_t stimulusID;
+    std::string parameterNames; // ';' separated
+    std::vector<double> parameterValues;
+    std::string jsonParameters;
+};
+
+/** Parameters registered once and referenced by later injections. */
+struct StimulusTemplateRecord
+{
+    uint64_t templateID;
+    std::string model;
+    std::string parameterNames; // ';' separated
+    std::vector<double> parameterValues;
+    std::string jsonParameters;
+};
+
+/** Magic number of a steering message ("MSTR" in little endian). */
+const uint32_t MUSIC_MESSAGE_MAGIC = 0x5254534d;
+const uint32_t MUSIC_MESSAGE_VERSION = 1;
+
+/** Accumulates steering records into a single MUSIC message. */
+class MusicMessageWriter
+{
+public:
+    MusicMessageWriter();
+
+    /** Append a stimulus injection record. */
+    void addStimulusInjection(const std::string& jsonParameters,
+                              const uint32_t* cells, size_t cellCount,
+                              bool multiple);
+
+    /** Append a compact stimulus injection record. */
+    void addStimulusInjection(const CompactStimulusInjectionRecord& record);
+
+    /** Append a stimulus update record. */
+    void addStimulusUpdate(const StimulusUpdateRecord& record);
+
+    /** Append a stimulus removal record. */
+    void addStimulusRemoval(uint64_t stimulusID);
+
+    /** Append a stimulus template record. */
+    void addStimulusTemplate(const StimulusTemplateRecord& record);
+
+    /**
+     * Append all the records of another binary message.
+     * @throw std::runtime_error if the message is malformed.
+     */
+    void addRecords(const void* data, size_t size);
+
+    /** Append a timing record, used to measure the steering latency. */
+    void addTiming(double receiveTime, double sendTime, double simulationTime);
+
+    /** @return true if no record has been added since the last clear(). */
+    bool empty() const { return getRecordCount() == 0; }
+    /** @return the number of records in the message. */
+    size_t getRecordCount() const;
+
+    /** @return the binary message. */
+    const void* getData() const { return _words.data(); }
+    /** @return the size of the binary message in bytes. */
+    size_t getSize() const { return _words.size() * sizeof(uint32_t); }
+    /** @return the binary message encoded as base64 text. */
+    std::string toBase64() const;
+
+    /** Remove all records. */
+    void clear();
+
+private:
+    std::vector<uint32_t> _words;
+
+    size_t _beginRecord(MusicMessageRecord type);
+    void _endRecord(size_t recordStart);
+    void _appendBytes(const void* data, size_t size);
+};
+
+/** A stimulus injection record, pointing into the reader buffer. */
+struct StimulusInjectionRecord
+{
+    std::string jsonParameters;
+    const uint32_t* cells;
+    size_t cellCount;
+    bool multiple;
+};
+
+/** A timing record, see MusicMessageRecord. */
+struct TimingRecord
+{
+    double receiveTime;
+    double sendTime;
+    double simulationTime;
+};
+
+/** Iterates over the records of a message created by MusicMessageWriter. */
+class MusicMessageReader
+{
+public:
+    /**
+     * Decode a base64 encoded message.
+     * @throw std::runtime_error if the message is malformed.
+     */
+    explicit MusicMessageReader(const std::string& base64);
+
+    /**
+     * Read a binary message. The data is copied.
+     * @throw std::runtime_error if the message is malformed.
+     */
+    MusicMessageReader(const void* data, size_t size);
+
+    /** @return the number of records in the message. */
+    size_t getRecordCount() const;
+
+    /**
+     * Advance to the next record.
+     * @return false if there are no more records.
+     * @throw std::runtime_error if the record overflows the message.
+     */
+    bool next();
+
+    /** @return the type of the current record. */
+    MusicMessageRecord getType() const;
+
+    /**
+     * @return the current record as a stimulus injection.
+     * @throw std::runtime_error if the record has a different type or is
+     *        malformed.
+     */
+    StimulusInjectionRecord getStimulusInjection() const;
+
+    /**
+     * @return the current record as a compact stimulus injection.
+     * @throw std::runtime_error if the record has a different type or is
+     *        malformed.
+     */
+    CompactStimulusInjectionRecord getCompactStimulusInjection() const;
+
+    /**
+     * @return the current record as a stimulus update.
+     * @throw std::runtime_error if the record has a different type or is
+     *        malformed.
+     */
+    StimulusUpdateRecord getStimulusUpdate() const;
+
+    /**
+     * @return the stimulus id of the current stimulus removal record.
+     * @throw std::runtime_error if the record has a different type or is
+     *        malformed.
+     */
+    uint64_t getStimulusRemoval() const;
+
+    /**
+     * @return the current record as a stimulus template.
+     * @throw std::runtime_error if the record has a different type or is
+     *        malformed.
+     */
+    StimulusTemplateRecord getStimulusTemplate() const;
+
+    /**
+     * @return the current record as a timing record.
+     * @throw std::runtime_error if the record has a different type or is
+     *        malformed.
+     */
+    TimingRecord getTiming() const;
+
+private:
+    std::vector<uint32_t> _words;
+    size_t _current;
+    size_t _next;
+
+    void _checkHeader();
+};
+}
+}
+#endif
@@ -0,0 +1,79 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_STEERING_NOTIFIER_H
+#define MONSTEER_STEERING_NOTIFIER_H
+
+#include <boost/noncopyable.hpp>
+
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace monsteer
+{
+/**
+ * A pipe that becomes readable when some future may have become ready, so
+ * an event loop can watch it with select or poll instead of a thread per
+ * future. The thread that completes the futures calls notify() after
+ * setting them. The watcher drains the pipe, then checks its futures.
+ *
+ * Both ends are non-blocking: notify() drops the byte if the pipe is full,
+ * which already makes it readable.
+ */
+class Notifier : public boost::noncopyable
+{
+public:
+    Notifier()
+    {
+        int fds[2];
+        if (::pipe(fds) != 0)
+            throw std::runtime_error("Cannot create a notification pipe");
+        _read = fds[0];
+        _write = fds[1];
+        for (const int fd : fds)
+        {
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+
+    ~Notifier()
+    {
+        ::close(_read);
+        ::close(_write);
+    }
+
+    /** @return the descriptor to watch for reading. */
+    int getDescriptor() const { return _read; }
+    void notify()
+    {
+        const char byte = 0;
+        while (::write(_write, &byte, 1) < 0 && errno == EINTR)
+            ;
+    }
+
+private:
+    int _read;
+    int _write;
+};
+}
+
+#endif
@@ -0,0 +1,365 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "nestConnection.h"
+
+#include <zeroeq/zeroeq.h>
+
+#include <monsteer/steering/playbackState.h>
+#include <monsteer/steering/reply.h>
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+namespace monsteer
+{
+namespace steering
+{
+namespace
+{
+const uint32_t receiveTimeout = 10;     // ms, bounds the stop latency
+const uint32_t expiryInterval = 100;    // ms
+const uint32_t minProbeInterval = 10;   // ms
+const uint32_t maxProbeInterval = 1000; // ms
+const size_t maxProbes = 100;           // Replies to older probes are ignored
+const size_t maxQueuedEvents = 10000;   // Before the proxies are connected
+
+std::mutex _connectionsMutex;
+std::map<std::string, std::shared_ptr<NESTConnection>> _connections;
+
+using SubscriberPtr = std::unique_ptr<zeroeq::Subscriber>;
+SubscriberPtr _createSubscriber(const URI& subscriber)
+{
+    const zeroeq::URI uri(subscriber);
+    if (uri.getHost().empty() || uri.getPort() == 0)
+        return SubscriberPtr(new zeroeq::Subscriber);
+    return SubscriberPtr(new zeroeq::Subscriber(uri));
+}
+
+uint64_t _createMessageIDBase()
+{
+    std::random_device device;
+    return uint64_t(device()) << 32;
+}
+
+using Clock = std::chrono::steady_clock;
+Clock::time_point _getDeadline(const std::chrono::milliseconds timeout)
+{
+    if (timeout.count() <= 0)
+        return Clock::time_point::max();
+    return Clock::now() + timeout;
+}
+
+std::exception_ptr _timeoutError()
+{
+    return std::make_exception_ptr(
+        std::runtime_error("Steering request not acknowledged in time"));
+}
+}
+
+// Copy of a published event, ZeroBuf events serialize to their own buffer.
+class NESTConnection::QueuedEvent : public servus::Serializable
+{
+public:
+    explicit QueuedEvent(const servus::Serializable& event)
+        : _typeName(event.getTypeName())
+        , _type(event.getTypeIdentifier())
+    {
+        const auto data = event.toBinary();
+        const auto bytes = static_cast<const uint8_t*>(data.ptr.get());
+        _data.assign(bytes, bytes + data.size);
+    }
+
+    std::string getTypeName() const final { return _typeName; }
+    servus::uint128_t getTypeIdentifier() const final { return _type; }
+private:
+    const std::string _typeName;
+    const servus::uint128_t _type;
+    std::vector<uint8_t> _data;
+
+    Data _toBinary() const final
+    {
+        // The buffer is owned by the event, which outlives the publish call.
+        Data data;
+        data.ptr =
+            std::shared_ptr<const void>(_data.data(), [](const void*) {});
+        data.size = _data.size();
+        return data;
+    }
+};
+
+std::shared_ptr<NESTConnection> NESTConnection::get(const URI& subscriber)
+{
+    // The scheme and query of the URI do not change the endpoint.
+    const std::string endpoint =
+        subscriber.getHost() + ":" + std::to_string(subscriber.getPort());
+
+    std::lock_guard<std::mutex> lock(_connectionsMutex);
+    std::shared_ptr<NESTConnection>& connection = _connections[endpoint];
+    if (!connection)
+        connection = std::make_shared<NESTConnection>(subscriber);
+    return connection;
+}
+
+NESTConnection::NESTConnection(const URI& subscriber)
+    : _subscriber(_createSubscriber(subscriber))
+    , _publisher(new zeroeq::Publisher())
+    , _messageIDBase(_createMessageIDBase())
+    , _messageCount(0)
+    , _requiredProxies(1)
+    , _connectedProxies(0)
+    , _connected(false)
+    , _running(true)
+{
+    _subscriber->subscribe(Acknowledgement::ZEROBUF_TYPE_IDENTIFIER(),
+                           [&](const void* data, const size_t size) {
+                               _onAcknowledgement(data, size);
+                           });
+    _subscriber->subscribe(StatusReply::ZEROBUF_TYPE_IDENTIFIER(),
+                           [&](const void* data, const size_t size) {
+                               _onStatusReply(data, size);
+                           });
+    _replyThread = std::thread([this] {
+        uint32_t probeInterval = minProbeInterval;
+        auto nextProbe = Clock::now();
+        auto nextExpiry = Clock::now();
+        while (_running)
+        {
+            const auto now = Clock::now();
+            if (_connected)
+                probeInterval = minProbeInterval;
+            else if (now >= nextProbe)
+            {
+                // Back off while the proxies are not started.
+                _probe();
+                nextProbe = now + std::chrono::milliseconds(probeInterval);
+                probeInterval = std::min(probeInterval * 2, maxProbeInterval);
+            }
+
+            if (now >= nextExpiry)
+            {
+                _expireRequests();
+                nextExpiry = now + std::chrono::milliseconds(expiryInterval);
+            }
+            _subscriber->receive(receiveTimeout);
+        }
+    });
+}
+
+NESTConnection::~NESTConnection()
+{
+    _running = false;
+    _replyThread.join();
+    // The futures of the pending requests get a broken promise error.
+}
+
+void NESTConnection::requireProxies(const size_t count)
+{
+    std::lock_guard<std::mutex> lock(_pendingMutex);
+    _proxyRequirements.insert(count);
+    _requiredProxies = std::max(_requiredProxies, count);
+    if (_connectedProxies >= _requiredProxies)
+        return;
+
+    std::lock_guard<std::mutex> publishLock(_publishMutex);
+    _connected = false;
+}
+
+void NESTConnection::releaseProxies(const size_t count)
+{
+    std::lock_guard<std::mutex> lock(_pendingMutex);
+    const auto i = _proxyRequirements.find(count);
+    if (i != _proxyRequirements.end())
+        _proxyRequirements.erase(i);
+    _requiredProxies =
+        _proxyRequirements.empty() ? 1 : *_proxyRequirements.rbegin();
+    if (!_connected && _connectedProxies >= _requiredProxies)
+        _setConnected();
+}
+
+void NESTConnection::publish(const servus::Serializable& event)
+{
+    std::lock_guard<std::mutex> lock(_publishMutex);
+    if (_connected)
+        _publisher->publish(event);
+    else
+        _queue.emplace_back(new QueuedEvent(event));
+}
+
+std::pair<uint64_t, std::future<double>> NESTConnection::newRequest(
+    const size_t replies, const std::chrono::milliseconds timeout)
+{
+    _checkQueue();
+    const uint64_t messageID = _newMessageID();
+    std::promise<double> promise;
+    std::future<double> future = promise.get_future();
+
+    std::lock_guard<std::mutex> lock(_pendingMutex);
+    _pending.emplace(messageID,
+                     PendingRequest{std::move(promise), replies, 0,
+                                    _getDeadline(timeout)});
+    return std::make_pair(messageID, std::move(future));
+}
+
+std::pair<uint64_t, std::future<SimulationStatus>>
+    NESTConnection::newStatusRequest(const size_t replies,
+                                     const std::chrono::milliseconds timeout)
+{
+    _checkQueue();
+    const uint64_t messageID = _newMessageID();
+    std::promise<SimulationStatus> promise;
+    std::future<SimulationStatus> future = promise.get_future();
+
+    // The time is the minimum of the replies, see _onStatusReply.
+    const SimulationStatus status{std::numeric_limits<double>::max(),
+                                  State::PAUSE, 0, 0};
+    std::lock_guard<std::mutex> lock(_pendingMutex);
+    _pendingStatus.emplace(messageID,
+                           PendingStatus{std::move(promise), replies, status,
+                                         _getDeadline(timeout)});
+    return std::make_pair(messageID, std::move(future));
+}
+
+// The queue may exceed the limit by the events of one request, one per
+// simulation of an ensemble.
+void NESTConnection::_checkQueue()
+{
+    std::lock_guard<std::mutex> lock(_publishMutex);
+    if (!_connected && _queue.size() >= maxQueuedEvents)
+        throw std::runtime_error(
+            "Too many steering requests queued, no simulation proxy is "
+            "connected");
+}
+
+// Called from the reply thread only.
+void NESTConnection::_probe()
+{
+    const uint64_t messageID = _newMessageID();
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        _probes.emplace(messageID, 0);
+        if (_probes.size() > maxProbes)
+            _probes.erase(_probes.begin());
+    }
+    std::lock_guard<std::mutex> lock(_publishMutex);
+    _publisher->publish(StatusRequest(messageID));
+}
+
+// Called from the reply thread only.
+void NESTConnection::_expireRequests()
+{
+    const auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(_pendingMutex);
+    for (auto i = _pending.begin(); i != _pending.end();)
+    {
+        if (i->second.deadline > now)
+        {
+            ++i;
+            continue;
+        }
+        i->second.promise.set_exception(_timeoutError());
+        i = _pending.erase(i);
+        _notifier.notify();
+    }
+    for (auto i = _pendingStatus.begin(); i != _pendingStatus.end();)
+    {
+        if (i->second.deadline > now)
+        {
+            ++i;
+            continue;
+        }
+        i->second.promise.set_exception(_timeoutError());
+        i = _pendingStatus.erase(i);
+        _notifier.notify();
+    }
+}
+
+// Called with _pendingMutex locked.
+void NESTConnection::_setConnected()
+{
+    std::lock_guard<std::mutex> lock(_publishMutex);
+    for (const auto& event : _queue)
+        _publisher->publish(*event);
+    _queue.clear();
+    _probes.clear();
+    _connected = true;
+}
+
+void NESTConnection::_onAcknowledgement(const void* data, const size_t size)
+{
+    ConstAcknowledgementPtr ack = Acknowledgement::create(data, size);
+    const auto& messageIDs = ack->getMessageIDs();
+
+    std::lock_guard<std::mutex> lock(_pendingMutex);
+    for (const uint64_t messageID : messageIDs)
+    {
+        // Acknowledgements of other clients are ignored.
+        auto i = _pending.find(messageID);
+        if (i == _pending.end())
+            continue;
+
+        PendingRequest& pending = i->second;
+        pending.time = std::max(pending.time, ack->getTime());
+        if (--pending.replies != 0)
+            continue;
+        pending.promise.set_value(pending.time);
+        _pending.erase(i);
+        _notifier.notify();
+    }
+}
+
+// The status of an ensemble has the time and state of its slowest
+// simulation and the total cell and stimulus counts.
+void NESTConnection::_onStatusReply(const void* data, const size_t size)
+{
+    ConstStatusReplyPtr reply = StatusReply::create(data, size);
+
+    std::lock_guard<std::mutex> lock(_pendingMutex);
+    auto probe = _probes.find(reply->getMessageID());
+    if (probe != _probes.end())
+    {
+        // Each proxy replies once to each probe it receives.
+        _connectedProxies = std::max(_connectedProxies, ++probe->second);
+        if (!_connected && _connectedProxies >= _requiredProxies)
+            _setConnected();
+        return;
+    }
+
+    auto i = _pendingStatus.find(reply->getMessageID());
+    if (i == _pendingStatus.end())
+        return;
+
+    PendingStatus& pending = i->second;
+    if (reply->getTime() < pending.status.time)
+    {
+        pending.status.time = reply->getTime();
+        pending.status.state = reply->getState();
+    }
+    pending.status.cellCount += reply->getCellCount();
+    pending.status.stimulusCount += reply->getStimulusCount();
+    if (--pending.replies != 0)
+        return;
+    pending.promise.set_value(pending.status);
+    _pendingStatus.erase(i);
+    _notifier.notify();
+}
+}
+}
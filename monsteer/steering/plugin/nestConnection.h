@@ -0,0 +1,160 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_PLUGIN_NESTCONNECTION_H
+#define MONSTEER_PLUGIN_NESTCONNECTION_H
+
+#include <monsteer/steering/notifier.h>
+#include <monsteer/steering/simulator.h> // SimulationStatus
+#include <monsteer/types.h>
+#include <zeroeq/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace monsteer
+{
+namespace steering
+{
+/**
+ * ZeroEQ request publisher and reply subscriber of a simulation endpoint,
+ * shared by all the NESTSimulator plugins of the process that steer it.
+ *
+ * ZeroMQ drops the events published before the subscribers have connected.
+ * Instead of relying on a startup delay, the connection probes the proxies
+ * with status requests every few milliseconds and queues the published
+ * events until the expected number of proxies have replied to a probe, then
+ * sends them in order. The probes are sent less often while no proxy
+ * answers, and new requests are refused when the queue is full.
+ *
+ * Requests that are not acknowledged in time fail with std::runtime_error.
+ * The reply thread notifies getReplyDescriptor() whenever it completes the
+ * future of a request.
+ */
+class NESTConnection
+{
+public:
+    /**
+     * @return the connection to the endpoint of a reply subscriber URI,
+     *         created on first use and kept for the life of the process,
+     *         so creating and destroying simulators is cheap and the
+     *         requests queued by a destroyed simulator are still sent.
+     */
+    static std::shared_ptr<NESTConnection> get(const URI& subscriber);
+
+    explicit NESTConnection(const URI& subscriber);
+    ~NESTConnection();
+
+    /**
+     * Queue the events until at least count proxies are connected, until
+     * releaseProxies(count) is called.
+     */
+    void requireProxies(size_t count);
+
+    /** Undo a requireProxies(count) call of a simulator being destroyed. */
+    void releaseProxies(size_t count);
+
+    /** Publish an event, or queue it if the proxies are not connected. */
+    void publish(const servus::Serializable& event);
+
+    /**
+     * @param replies the number of acknowledgements expected.
+     * @param timeout the time after which the future fails if they have not
+     *        been received, 0 to wait forever.
+     * @return a new message ID and the future resolved when the
+     *         acknowledgements have been received, with the latest time.
+     * @throw std::runtime_error if the proxies are not connected and the
+     *        queue of events is full.
+     */
+    std::pair<uint64_t, std::future<double>> newRequest(
+        size_t replies, std::chrono::milliseconds timeout);
+
+    /**
+     * @return a new message ID and the future resolved when the given number
+     *         of status replies have been received, see _onStatusReply.
+     * @throw std::runtime_error if the queue of events is full.
+     */
+    std::pair<uint64_t, std::future<SimulationStatus>> newStatusRequest(
+        size_t replies, std::chrono::milliseconds timeout);
+
+    /** @copydoc monsteer::Simulator::getReplyDescriptor */
+    int getReplyDescriptor() const { return _notifier.getDescriptor(); }
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct PendingRequest
+    {
+        std::promise<double> promise;
+        size_t replies; // Acknowledgements still expected
+        double time;
+        Clock::time_point deadline;
+    };
+
+    struct PendingStatus
+    {
+        std::promise<SimulationStatus> promise;
+        size_t replies;
+        SimulationStatus status;
+        Clock::time_point deadline;
+    };
+
+    class QueuedEvent;
+
+    std::unique_ptr<zeroeq::Subscriber> _subscriber;
+    std::unique_ptr<zeroeq::Publisher> _publisher;
+
+    // Random base so the IDs of several clients of the same simulation do
+    // not collide. 0 is reserved for requests that are not acknowledged.
+    const uint64_t _messageIDBase;
+    std::atomic<uint64_t> _messageCount;
+    std::mutex _pendingMutex;
+    std::unordered_map<uint64_t, PendingRequest> _pending;
+    std::unordered_map<uint64_t, PendingStatus> _pendingStatus;
+
+    // Probes sent while connecting, with their number of replies
+    std::map<uint64_t, size_t> _probes;
+    std::multiset<size_t> _proxyRequirements;
+    size_t _requiredProxies;
+    size_t _connectedProxies;
+
+    std::mutex _publishMutex; // Locked after _pendingMutex
+    std::atomic<bool> _connected;
+    std::deque<std::unique_ptr<QueuedEvent>> _queue;
+
+    Notifier _notifier;
+    std::atomic<bool> _running;
+    std::thread _replyThread;
+
+    uint64_t _newMessageID() { return _messageIDBase + ++_messageCount; }
+    void _checkQueue();
+    void _probe();
+    void _expireRequests();
+    void _setConnected();
+    void _onAcknowledgement(const void* data, size_t size);
+    void _onStatusReply(const void* data, size_t size);
+};
+}
+}
+#endif
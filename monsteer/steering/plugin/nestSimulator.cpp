@@ -18,6 +18,7 @@
  */
 
 #include "nestSimulator.h"
+#include "nestConnection.h"
 
 #include <monsteer/types.h>
 
@@ -26,8 +27,16 @@
 #include <lunchbox/debug.h>
 #include <lunchbox/pluginRegisterer.h>
 
+#include <monsteer/steering/cellSet.h>
+#include <monsteer/steering/ensemble.h>
+#include <monsteer/steering/musicMessage.h>
 #include <monsteer/steering/playbackState.h>
 #include <monsteer/steering/stimulus.h>
+#include <monsteer/steering/stimulusBatch.h>
+#include <monsteer/steering/stimulusParameters.h>
+
+#include <limits>
+#include <sstream>
 
 namespace monsteer
 {
@@ -37,20 +46,87 @@ namespace
 {
 lunchbox::PluginRegisterer<NESTSimulator> registerer;
 
-using SubscriberPtr = std::unique_ptr<zeroeq::Subscriber>;
-SubscriberPtr _createSubscriber(const SimulatorPluginInitData& pluginData)
+const uint32_t allSimulations = std::numeric_limits<uint32_t>::max();
+
+// Bounds the routing table of the stimuli that are never removed.
+const size_t maxStimulusTargets = 65536;
+
+const std::chrono::milliseconds defaultTimeout(60000);
+
+std::chrono::milliseconds _getTimeout(const URI& uri)
+{
+    const auto i = uri.findQuery("timeout");
+    if (i == uri.queryEnd())
+        return defaultTimeout;
+
+    std::istringstream is(i->second);
+    uint32_t timeout = 0;
+    if (!(is >> timeout) || !(is >> std::ws).eof())
+        throw std::runtime_error("Invalid timeout in URI: " + i->second);
+    return std::chrono::milliseconds(timeout);
+}
+
+// The cells and the messageID are assigned by the caller.
+StimulusInjectionV2 _createInjection(const std::string& jsonParameters,
+                                     const bool multiple)
+{
+    StimulusInjectionV2 event;
+    event.setJsonParameters(jsonParameters);
+    event.setMultiple(multiple);
+    return event;
+}
+
+StimulusInjectionV2 _createInjection(const StimulusParameters& parameters,
+                                     const bool multiple)
+{
+    StimulusInjectionV2 event;
+    event.setModel(parameters.getModel());
+    event.setParameterNames(parameters.getJoinedNames());
+    event.setParameterValues(parameters.getValues());
+    event.setJsonParameters(parameters.getJSON());
+    event.setTime(parameters.getTime());
+    event.setTemplateID(parameters.getTemplate());
+    event.setMultiple(multiple);
+    return event;
+}
+
+void _setCells(StimulusInjectionV2& event, const brion::uint32_ts& cells)
+{
+    brion::uint32_ts encoded;
+    event.setCellEncoding(encodeCells(cells.data(), cells.size(), encoded));
+    event.setCells(encoded);
+}
+
+StimulusUpdate _createUpdate(const uint64_t stimulusID)
+{
+    StimulusUpdate event;
+    event.setStimulusID(stimulusID);
+    return event;
+}
+
+InjectionBatch _createBatch(const uint64_t messageID,
+                            const MusicMessageWriter& message)
 {
-    const zeroeq::URI uri(pluginData.subscriber);
-    if (uri.getHost().empty() || uri.getPort() == 0)
-        return SubscriberPtr(new zeroeq::Subscriber);
-    return SubscriberPtr(new zeroeq::Subscriber(uri));
+    InjectionBatch event;
+    event.setMessageID(messageID);
+    event.setRecords(static_cast<const uint8_t*>(message.getData()),
+                     message.getSize());
+    return event;
 }
 }
 
 NESTSimulator::NESTSimulator(const SimulatorPluginInitData& pluginData)
-    : _replySubscriber(_createSubscriber(pluginData))
-    , _requestPublisher(new zeroeq::Publisher())
+    : _connection(NESTConnection::get(pluginData.subscriber))
+    , _timeout(_getTimeout(pluginData.subscriber))
+    , _simulations(0)
+{
+    _setupEnsemble(pluginData.subscriber);
+    _connection->requireProxies(_getReplyCount());
+}
+
+NESTSimulator::~NESTSimulator()
 {
+    _connection->releaseProxies(_getReplyCount());
 }
 
 bool NESTSimulator::handles(const SimulatorPluginInitData& pluginData)
@@ -62,35 +138,405 @@ bool NESTSimulator::handles(const SimulatorPluginInitData& pluginData)
 std::string NESTSimulator::getDescription()
 {
     return std::string("NEST Simulator: ") +
-           MONSTEER_NEST_SIMULATOR_PLUGIN_SCHEME + "://";
+           MONSTEER_NEST_SIMULATOR_PLUGIN_SCHEME + "://[?simulations=count|" +
+           "?cells=first-last,...][&timeout=ms]";
 }
 
-void NESTSimulator::injectStimulus(const std::string& jsonParameters,
-                                   const brion::uint32_ts& cells)
+std::future<double> NESTSimulator::injectStimulus(
+    const std::string& jsonParameters, const brion::uint32_ts& cells)
 {
-    // The messageID is irrelevant for the moment
-    _requestPublisher->publish(StimulusInjection("", "EVENT_STIMULUSINJECTION",
-                                                 cells, jsonParameters,
-                                                 /*single*/ false));
+    auto event = _createInjection(jsonParameters, /*multiple*/ false);
+    return std::move(_inject(event, cells).second);
 }
 
-void NESTSimulator::injectMultipleStimuli(const std::string& jsonParameters,
-                                          const brion::uint32_ts& cells)
+std::future<double> NESTSimulator::injectMultipleStimuli(
+    const std::string& jsonParameters, const brion::uint32_ts& cells)
 {
-    // The messageID is irrelevant for the moment
-    _requestPublisher->publish(StimulusInjection("", "EVENT_STIMULUSINJECTION",
-                                                 cells, jsonParameters,
-                                                 /*multiple*/ true));
+    auto event = _createInjection(jsonParameters, /*multiple*/ true);
+    return std::move(_inject(event, cells).second);
 }
 
-void NESTSimulator::play()
+std::future<double> NESTSimulator::injectStimulus(
+    const StimulusParameters& parameters, const brion::uint32_ts& cells)
 {
-    _requestPublisher->publish(PlaybackState(State::PLAY));
+    auto event = _createInjection(parameters, /*multiple*/ false);
+    return std::move(_inject(event, cells).second);
+}
+
+std::future<double> NESTSimulator::injectMultipleStimuli(
+    const StimulusParameters& parameters, const brion::uint32_ts& cells)
+{
+    auto event = _createInjection(parameters, /*multiple*/ true);
+    return std::move(_inject(event, cells).second);
+}
+
+StimulusHandle NESTSimulator::createStimulus(
+    const StimulusParameters& parameters, const brion::uint32_ts& cells,
+    const bool multiple)
+{
+    // The message ID of the creation request identifies the stimulus.
+    auto event = _createInjection(parameters, multiple);
+    std::vector<uint32_t> targets;
+    auto request = _inject(event, cells, &targets);
+    _addTargets(request.first, std::move(targets));
+    return StimulusHandle{request.first, std::move(request.second)};
+}
+
+monsteer::StimulusTemplate NESTSimulator::registerTemplate(
+    const StimulusParameters& parameters)
+{
+    // The message ID of the registration request identifies the template.
+    auto request = _connection->newRequest(_getReplyCount(), _timeout);
+    TemplateRegistration event;
+    event.setMessageID(request.first);
+    event.setModel(parameters.getModel());
+    event.setParameterNames(parameters.getJoinedNames());
+    event.setParameterValues(parameters.getValues());
+    event.setJsonParameters(parameters.getJSON());
+    _publish(event, allSimulations);
+    return monsteer::StimulusTemplate{request.first, std::move(request.second)};
+}
+
+std::future<double> NESTSimulator::updateStimulus(
+    const uint64_t stimulusID, const StimulusParameters& parameters)
+{
+    auto event = _createUpdate(stimulusID);
+    event.setParameterNames(parameters.getJoinedNames());
+    event.setParameterValues(parameters.getValues());
+    event.setJsonParameters(parameters.getJSON());
+    return _update(event);
+}
+
+std::future<double> NESTSimulator::removeStimulus(const uint64_t stimulusID)
+{
+    auto event = _createUpdate(stimulusID);
+    event.setRemove(true);
+    return _update(event);
+}
+
+std::future<double> NESTSimulator::submit(const StimulusBatch& batch)
+{
+    const auto& message = batch.getMessage();
+    if (_cellRanges.empty() || message.empty())
+    {
+        auto request = _connection->newRequest(_getReplyCount(), _timeout);
+        _publish(_createBatch(request.first, message), allSimulations);
+        return std::move(request.second);
+    }
+
+    // Each simulation receives the injections of its own cells and the
+    // updates of the stimuli it received, as in _inject and _update. Unknown
+    // cells throw before anything is published.
+    std::vector<MusicMessageWriter> messages(_cellRanges.size());
+    const auto findMessages = [&](const uint64_t stimulusID,
+                                  const bool remove) {
+        std::vector<MusicMessageWriter*> targets;
+        for (const uint32_t simulation : _getTargets(stimulusID, remove))
+            targets.push_back(&messages[simulation]);
+        if (targets.empty())
+        {
+            for (auto& simulationMessage : messages)
+                targets.push_back(&simulationMessage);
+        }
+        return targets;
+    };
+
+    MusicMessageReader reader(message.getData(), message.getSize());
+    brion::uint32_ts encoded;
+    while (reader.next())
+    {
+        switch (reader.getType())
+        {
+        case MusicMessageRecord::stimulusInjection:
+        {
+            const auto record = reader.getStimulusInjection();
+            const auto subsets = _splitCells(record.cells, record.cellCount);
+            for (size_t i = 0; i != subsets.size(); ++i)
+            {
+                if (!subsets[i].empty() || record.cellCount == 0)
+                    messages[i].addStimulusInjection(record.jsonParameters,
+                                                     subsets[i].data(),
+                                                     subsets[i].size(),
+                                                     record.multiple);
+            }
+            break;
+        }
+        case MusicMessageRecord::compactStimulusInjection:
+        {
+            auto record = reader.getCompactStimulusInjection();
+            const auto cells = decodeCells(record.cellEncoding, record.cells,
+                                           record.cellWords);
+            const auto subsets = _splitCells(cells.data(), cells.size());
+            for (size_t i = 0; i != subsets.size(); ++i)
+            {
+                if (subsets[i].empty() && !cells.empty())
+                    continue;
+                record.cellEncoding = encodeCells(subsets[i].data(),
+                                                  subsets[i].size(), encoded);
+                record.cells = encoded.data();
+                record.cellWords = encoded.size();
+                messages[i].addStimulusInjection(record);
+            }
+            break;
+        }
+        case MusicMessageRecord::stimulusUpdate:
+        {
+            const auto record = reader.getStimulusUpdate();
+            for (auto target : findMessages(record.stimulusID, false))
+                target->addStimulusUpdate(record);
+            break;
+        }
+        case MusicMessageRecord::stimulusRemoval:
+        {
+            const uint64_t stimulusID = reader.getStimulusRemoval();
+            for (auto target : findMessages(stimulusID, true))
+                target->addStimulusRemoval(stimulusID);
+            break;
+        }
+        case MusicMessageRecord::stimulusTemplate:
+        {
+            const auto record = reader.getStimulusTemplate();
+            for (auto& simulationMessage : messages)
+                simulationMessage.addStimulusTemplate(record);
+            break;
+        }
+        case MusicMessageRecord::timing:
+            break; // Only written by the proxies
+        }
+    }
+
+    std::vector<uint32_t> simulations;
+    for (uint32_t i = 0; i != messages.size(); ++i)
+    {
+        if (!messages[i].empty())
+            simulations.push_back(i);
+    }
+
+    if (simulations.empty())
+    {
+        auto request = _connection->newRequest(_getReplyCount(), _timeout);
+        _publish(_createBatch(request.first, message), allSimulations);
+        return std::move(request.second);
+    }
+
+    auto request = _connection->newRequest(simulations.size(), _timeout);
+    for (const uint32_t simulation : simulations)
+        _publish(_createBatch(request.first, messages[simulation]),
+                 simulation);
+    return std::move(request.second);
+}
+
+std::future<double> NESTSimulator::play()
+{
+    auto request = _connection->newRequest(_getReplyCount(), _timeout);
+    _publish(PlaybackState(State::PLAY, 0, 0, request.first), allSimulations);
+    return std::move(request.second);
+}
+
+std::future<double> NESTSimulator::pause()
+{
+    auto request = _connection->newRequest(_getReplyCount(), _timeout);
+    _publish(PlaybackState(State::PAUSE, 0, 0, request.first), allSimulations);
+    return std::move(request.second);
+}
+
+std::future<double> NESTSimulator::step(const uint32_t count)
+{
+    auto request = _connection->newRequest(_getReplyCount(), _timeout);
+    _publish(PlaybackState(State::STEP, count, 0, request.first),
+             allSimulations);
+    return std::move(request.second);
+}
+
+std::future<double> NESTSimulator::runUntil(const double timestamp)
+{
+    auto request = _connection->newRequest(_getReplyCount(), _timeout);
+    _publish(PlaybackState(State::RUN_UNTIL, 0, timestamp, request.first),
+             allSimulations);
+    return std::move(request.second);
+}
+
+std::future<SimulationStatus> NESTSimulator::getStatus()
+{
+    auto request = _connection->newStatusRequest(_getReplyCount(), _timeout);
+    _publish(StatusRequest(request.first), allSimulations);
+    return std::move(request.second);
+}
+
+int NESTSimulator::getReplyDescriptor() const
+{
+    return _connection->getReplyDescriptor();
+}
+
+void NESTSimulator::_setupEnsemble(const URI& uri)
+{
+    auto i = uri.findQuery("cells");
+    if (i != uri.queryEnd())
+    {
+        std::istringstream ranges(i->second);
+        std::string range;
+        while (std::getline(ranges, range, ','))
+        {
+            std::istringstream is(range);
+            CellRange cells;
+            char separator = 0;
+            if (!(is >> cells.first >> separator >> cells.last) ||
+                separator != '-' || cells.first > cells.last ||
+                !(is >> std::ws).eof())
+            {
+                throw std::runtime_error("Invalid cell range in URI: " +
+                                         range);
+            }
+            _cellRanges.push_back(cells);
+        }
+        _simulations = uint32_t(_cellRanges.size());
+    }
+
+    i = uri.findQuery("simulations");
+    if (i == uri.queryEnd())
+        return;
+
+    std::istringstream is(i->second);
+    uint32_t simulations = 0;
+    if (!(is >> simulations) || !(is >> std::ws).eof() || simulations == 0)
+        throw std::runtime_error("Invalid simulation count in URI: " +
+                                 i->second);
+    if (!_cellRanges.empty() && simulations != _simulations)
+        throw std::runtime_error(
+            "Simulation count does not match the cell ranges in URI");
+    _simulations = simulations;
+}
+
+uint32_t NESTSimulator::_findSimulation(const uint32_t cell) const
+{
+    for (size_t i = 0; i != _cellRanges.size(); ++i)
+    {
+        if (cell >= _cellRanges[i].first && cell <= _cellRanges[i].last)
+            return uint32_t(i);
+    }
+    throw std::runtime_error("Cell " + std::to_string(cell) +
+                             " is not in any simulation of the ensemble");
+}
+
+std::vector<brion::uint32_ts> NESTSimulator::_splitCells(
+    const uint32_t* cells, const size_t count) const
+{
+    std::vector<brion::uint32_ts> subsets(_cellRanges.size());
+    for (size_t i = 0; i != count; ++i)
+        subsets[_findSimulation(cells[i])].push_back(cells[i]);
+    return subsets;
+}
+
+// Events of an ensemble are wrapped with the index of their target
+// simulation. A single event is published for all the simulations.
+void NESTSimulator::_publish(const servus::Serializable& event,
+                             const uint32_t simulation)
+{
+    if (_simulations == 0)
+    {
+        _connection->publish(event);
+        return;
+    }
+
+    const auto data = event.toBinary();
+    const servus::uint128_t& type = event.getTypeIdentifier();
+    EnsembleRequest request;
+    request.setSimulation(simulation);
+    request.setTypeHigh(type.high());
+    request.setTypeLow(type.low());
+    request.setEvent(static_cast<const uint8_t*>(data.ptr.get()), data.size);
+    _connection->publish(request);
+}
+
+std::pair<uint64_t, std::future<double>> NESTSimulator::_inject(
+    StimulusInjectionV2& event, const brion::uint32_ts& cells,
+    std::vector<uint32_t>* targets)
+{
+    if (_cellRanges.empty() || cells.empty())
+    {
+        auto request = _connection->newRequest(_getReplyCount(), _timeout);
+        _setCells(event, cells);
+        event.setMessageID(request.first);
+        _publish(event, allSimulations);
+        return request;
+    }
+
+    // Each simulation only receives its own cells. Unknown cells throw
+    // before anything is published.
+    const auto subsets = _splitCells(cells.data(), cells.size());
+
+    std::vector<uint32_t> simulations;
+    for (uint32_t i = 0; i != subsets.size(); ++i)
+    {
+        if (!subsets[i].empty())
+            simulations.push_back(i);
+    }
+
+    auto request = _connection->newRequest(simulations.size(), _timeout);
+    event.setMessageID(request.first);
+    for (const uint32_t simulation : simulations)
+    {
+        _setCells(event, subsets[simulation]);
+        _publish(event, simulation);
+    }
+    if (targets)
+        *targets = std::move(simulations);
+    return request;
+}
+
+// Updates and removals only go to the simulations that received the
+// stimulus.
+std::future<double> NESTSimulator::_update(StimulusUpdate& event)
+{
+    const auto targets =
+        _getTargets(event.getStimulusID(), event.getRemove());
+    if (targets.empty())
+    {
+        auto request = _connection->newRequest(_getReplyCount(), _timeout);
+        event.setMessageID(request.first);
+        _publish(event, allSimulations);
+        return std::move(request.second);
+    }
+
+    auto request = _connection->newRequest(targets.size(), _timeout);
+    event.setMessageID(request.first);
+    for (const uint32_t simulation : targets)
+        _publish(event, simulation);
+    return std::move(request.second);
+}
+
+// Stimuli sent to the whole ensemble are not recorded, their updates are
+// broadcast anyway.
+void NESTSimulator::_addTargets(const uint64_t stimulusID,
+                                std::vector<uint32_t>&& targets)
+{
+    if (targets.empty() || targets.size() == _simulations)
+        return;
+
+    std::lock_guard<std::mutex> lock(_stimulusTargetsMutex);
+    _stimulusTargets.emplace(stimulusID, std::move(targets));
+    _stimulusTargetsOrder.push_back(stimulusID);
+    // Removed stimuli are still in the order queue, erasing them is a no-op.
+    if (_stimulusTargetsOrder.size() > maxStimulusTargets)
+    {
+        _stimulusTargets.erase(_stimulusTargetsOrder.front());
+        _stimulusTargetsOrder.pop_front();
+    }
 }
 
-void NESTSimulator::pause()
+// Returns an empty list for the stimuli sent to all the simulations.
+std::vector<uint32_t> NESTSimulator::_getTargets(const uint64_t stimulusID,
+                                                 const bool remove)
 {
-    _requestPublisher->publish(PlaybackState(State::PAUSE));
+    std::lock_guard<std::mutex> lock(_stimulusTargetsMutex);
+    const auto i = _stimulusTargets.find(stimulusID);
+    if (i == _stimulusTargets.end())
+        return std::vector<uint32_t>();
+    if (!remove)
+        return i->second;
+    auto targets = std::move(i->second);
+    _stimulusTargets.erase(i);
+    return targets;
 }
 }
 }
@@ -20,40 +20,143 @@
 #ifndef MONSTEER_PLUGIN_NESTSIMULATOR_H
 #define MONSTEER_PLUGIN_NESTSIMULATOR_H
 
+#include <monsteer/steering/simulator.h> // SimulationStatus
 #include <monsteer/steering/simulatorPlugin.h>
+#include <monsteer/steering/stimulus.h>
 #include <zeroeq/types.h>
 
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 namespace monsteer
 {
 namespace steering
 {
-/** Steering interface to NEST simulations */
+class NESTConnection;
+
+/**
+ * Steering interface to NEST simulations.
+ *
+ * A single plugin can also steer an ensemble of simulations, such as the
+ * replicas of a parameter sweep, through one publisher and one subscriber.
+ * The ensemble is given in the URI query:
+ * - nest://?simulations=32 broadcasts all the requests to 32 simulations.
+ * - nest://?cells=1-1000,1001-2000 routes the stimuli of each cell to the
+ *   simulation whose range contains it, and broadcasts all other requests.
+ *   The records of a StimulusBatch are routed the same way, each simulation
+ *   receives a batch with its own share.
+ * The proxy of each simulation is started with its index in the ensemble
+ * (--simulation-index). A request is acknowledged when all the simulations
+ * it was sent to have acknowledged it, with the latest of their times.
+ *
+ * The futures of the requests fail with std::runtime_error if they are not
+ * acknowledged within nest://?timeout=milliseconds, one minute by default
+ * and unlimited with timeout=0.
+ *
+ * All the plugins of a process steering the same endpoint share their
+ * sockets and reply thread, see NESTConnection.
+ */
 class NESTSimulator : public monsteer::SimulatorPlugin
 {
 public:
     explicit NESTSimulator(const SimulatorPluginInitData& pluginData);
+    ~NESTSimulator();
 
     /** Check if this plugin can handle the given plugin data. */
     static bool handles(const SimulatorPluginInitData& pluginData);
     static std::string getDescription();
 
     /** @copydoc monsteer::Simulator::injectStimulus */
-    void injectStimulus(const std::string& jsonParameters,
-                        const brion::uint32_ts& cells) final;
+    std::future<double> injectStimulus(const std::string& jsonParameters,
+                                       const brion::uint32_ts& cells) final;
 
     /** @copydoc monsteer::Simulator::injectMultipleStimuli */
-    void injectMultipleStimuli(const std::string& jsonParameters,
-                               const brion::uint32_ts& cells) final;
+    std::future<double> injectMultipleStimuli(
+        const std::string& jsonParameters,
+        const brion::uint32_ts& cells) final;
+
+    /** Typed parameters version of Simulator::injectStimulus. */
+    std::future<double> injectStimulus(const StimulusParameters& parameters,
+                                       const brion::uint32_ts& cells) final;
+
+    /** Typed parameters version of Simulator::injectMultipleStimuli. */
+    std::future<double> injectMultipleStimuli(
+        const StimulusParameters& parameters,
+        const brion::uint32_ts& cells) final;
+
+    /** @copydoc monsteer::SimulatorPlugin::createStimulus */
+    StimulusHandle createStimulus(const StimulusParameters& parameters,
+                                  const brion::uint32_ts& cells,
+                                  bool multiple) final;
+
+    /** @copydoc monsteer::Simulator::registerTemplate */
+    monsteer::StimulusTemplate registerTemplate(
+        const StimulusParameters& parameters) final;
+
+    /** @copydoc monsteer::Simulator::updateStimulus */
+    std::future<double> updateStimulus(
+        uint64_t stimulusID, const StimulusParameters& parameters) final;
+
+    /** @copydoc monsteer::Simulator::removeStimulus */
+    std::future<double> removeStimulus(uint64_t stimulusID) final;
+
+    /** @copydoc monsteer::Simulator::submit */
+    std::future<double> submit(const StimulusBatch& batch) final;
 
     /** @copydoc monsteer::Simulator::play */
-    void play() final;
+    std::future<double> play() final;
 
     /** @copydoc monsteer::Simulator::pause */
-    void pause() final;
+    std::future<double> pause() final;
+
+    /** @copydoc monsteer::Simulator::step */
+    std::future<double> step(uint32_t count) final;
+
+    /** @copydoc monsteer::Simulator::runUntil */
+    std::future<double> runUntil(double timestamp) final;
+
+    /** @copydoc monsteer::Simulator::getStatus */
+    std::future<SimulationStatus> getStatus() final;
+
+    /** @copydoc monsteer::Simulator::getReplyDescriptor */
+    int getReplyDescriptor() const final;
 
 private:
-    std::unique_ptr<zeroeq::Subscriber> _replySubscriber;
-    std::unique_ptr<zeroeq::Publisher> _requestPublisher;
+    struct CellRange
+    {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    std::shared_ptr<NESTConnection> _connection;
+    const std::chrono::milliseconds _timeout; // Of each request
+
+    // Ensemble mode. _simulations is 0 when steering a single simulation.
+    uint32_t _simulations;
+    std::vector<CellRange> _cellRanges; // Indexed by simulation
+    // Simulations of the stimuli routed to a subset of the ensemble, for
+    // their updates and removal. The oldest entries are dropped beyond a
+    // fixed count, the updates of those stimuli are broadcast.
+    std::unordered_map<uint64_t, std::vector<uint32_t>> _stimulusTargets;
+    std::deque<uint64_t> _stimulusTargetsOrder;
+    std::mutex _stimulusTargetsMutex;
+
+    size_t _getReplyCount() const { return _simulations ? _simulations : 1; }
+    void _setupEnsemble(const URI& uri);
+    uint32_t _findSimulation(uint32_t cell) const;
+    std::vector<brion::uint32_ts> _splitCells(const uint32_t* cells,
+                                              size_t count) const;
+    void _addTargets(uint64_t stimulusID, std::vector<uint32_t>&& targets);
+    std::vector<uint32_t> _getTargets(uint64_t stimulusID, bool remove);
+    void _publish(const servus::Serializable& event, uint32_t simulation);
+    std::pair<uint64_t, std::future<double>> _inject(
+        StimulusInjectionV2& event, const brion::uint32_ts& cells,
+        std::vector<uint32_t>* targets = nullptr);
+    std::future<double> _update(StimulusUpdate& event);
 };
 }
 }
@@ -50,25 +50,91 @@ Simulator::~Simulator()
     delete _impl;
 }
 
-void Simulator::injectStimulus(const std::string& jsonParameters,
-                               const brion::uint32_ts& cells)
+std::future<double> Simulator::injectStimulus(
+    const std::string& jsonParameters, const brion::uint32_ts& cells)
 {
-    _impl->plugin->injectStimulus(jsonParameters, cells);
+    return _impl->plugin->injectStimulus(jsonParameters, cells);
 }
 
-void Simulator::injectMultipleStimuli(const std::string& jsonParameters,
-                                      const brion::uint32_ts& cells)
+std::future<double> Simulator::injectMultipleStimuli(
+    const std::string& jsonParameters, const brion::uint32_ts& cells)
 {
-    _impl->plugin->injectMultipleStimuli(jsonParameters, cells);
+    return _impl->plugin->injectMultipleStimuli(jsonParameters, cells);
 }
 
-void Simulator::play()
+std::future<double> Simulator::injectStimulus(
+    const StimulusParameters& parameters, const brion::uint32_ts& cells)
 {
-    _impl->plugin->play();
+    return _impl->plugin->injectStimulus(parameters, cells);
 }
 
-void Simulator::pause()
+std::future<double> Simulator::injectMultipleStimuli(
+    const StimulusParameters& parameters, const brion::uint32_ts& cells)
 {
-    _impl->plugin->pause();
+    return _impl->plugin->injectMultipleStimuli(parameters, cells);
+}
+
+StimulusHandle Simulator::createStimulus(const StimulusParameters& parameters,
+                                         const brion::uint32_ts& cells)
+{
+    return _impl->plugin->createStimulus(parameters, cells, false);
+}
+
+StimulusHandle Simulator::createMultipleStimuli(
+    const StimulusParameters& parameters, const brion::uint32_ts& cells)
+{
+    return _impl->plugin->createStimulus(parameters, cells, true);
+}
+
+StimulusTemplate Simulator::registerTemplate(
+    const StimulusParameters& parameters)
+{
+    return _impl->plugin->registerTemplate(parameters);
+}
+
+std::future<double> Simulator::updateStimulus(
+    const StimulusHandle& stimulus, const StimulusParameters& parameters)
+{
+    return _impl->plugin->updateStimulus(stimulus.id, parameters);
+}
+
+std::future<double> Simulator::removeStimulus(const StimulusHandle& stimulus)
+{
+    return _impl->plugin->removeStimulus(stimulus.id);
+}
+
+std::future<double> Simulator::submit(const StimulusBatch& batch)
+{
+    return _impl->plugin->submit(batch);
+}
+
+std::future<double> Simulator::play()
+{
+    return _impl->plugin->play();
+}
+
+std::future<double> Simulator::pause()
+{
+    return _impl->plugin->pause();
+}
+
+std::future<double> Simulator::step(const uint32_t count)
+{
+    return _impl->plugin->step(count);
+}
+
+std::future<double> Simulator::runUntil(const double timestamp)
+{
+    return _impl->plugin->runUntil(timestamp);
+}
+
+std::future<SimulationStatus> Simulator::getStatus()
+{
+    return _impl->plugin->getStatus();
+}
+
+int Simulator::getReplyDescriptor() const
+{
+    return _impl->plugin->getReplyDescriptor();
 }
 }
@@ -17,11 +17,62 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#ifndef MONSTEER_SIMULATOR_H
+#define MONSTEER_SIMULATOR_H
+
 #include <boost/noncopyable.hpp>
+#include <monsteer/steering/playbackState.h> // State
 #include <monsteer/types.h>
 
+#include <future>
+
 namespace monsteer
 {
+/**
+ * A stimulus created with Simulator::createStimulus().
+ *
+ * @version 0.8
+ */
+struct StimulusHandle
+{
+    uint64_t id;
+    /** Acknowledgement of the creation request. */
+    std::future<double> created;
+};
+
+/**
+ * Stimulus parameters registered with Simulator::registerTemplate().
+ *
+ * @version 0.8
+ */
+struct StimulusTemplate
+{
+    uint64_t id;
+    /** Acknowledgement of the registration request. */
+    std::future<double> registered;
+};
+
+/**
+ * Status of a simulation, see Simulator::getStatus().
+ *
+ * @version 0.8
+ */
+struct SimulationStatus
+{
+    /** Simulation time in milliseconds. */
+    double time;
+    /** Playback state. */
+    steering::State state;
+    /** Number of cells of the simulation. */
+    uint32_t cellCount;
+    /**
+     * Number of stimuli injected and not removed, including the injections
+     * of batches. Injections without a message ID cannot be removed, so
+     * they are counted for the rest of the simulation.
+     */
+    uint32_t stimulusCount;
+};
+
 /** Steering interface to the simulator of an experiment.
  *
  * This class provides access to the simulator engine for computational
@@ -30,6 +81,22 @@ namespace monsteer
  * The implementation is chosen automatically based on the URI that locates
  * the simulator in the network.
  *
+ * Requests are asynchronous. Each request carries a message ID and returns a
+ * future that becomes ready when the simulator acknowledges the request,
+ * with the simulation time in milliseconds at which it was inserted into the
+ * MUSIC port of the simulation, which applies it at its next step. Scheduled
+ * injections (StimulusParameters::setTime()) and batches containing them are
+ * acknowledged with the onset of their last injection instead, if later.
+ * Playback requests are acknowledged with the time at which they are
+ * applied. Any number of requests can be in flight at once. The futures
+ * of the requests not acknowledged when the last Simulator of the process
+ * steering the same simulation is destroyed throw std::future_error (broken
+ * promise).
+ *
+ * Simulators of the same simulation share their connection, so creating
+ * them is cheap. Requests made before the simulation has been reached are
+ * queued and delivered once it has, instead of being lost.
+ *
  * @version 0.2
  */
 class Simulator : public boost::noncopyable
@@ -56,14 +123,13 @@ public:
      * parameters provided. The stimulus source is connected to all cells
      * at the moment it is received by the simulator.
      *
-     * This operation may fail silently in the current implementation.
-     *
+     * @return the acknowledgement of the request.
      * @throw std::runtime_error if an error is detected in generator
      * parameters
      * @version 0.2
      */
-    void injectStimulus(const std::string& jsonParameters,
-                        const brion::uint32_ts& cells);
+    std::future<double> injectStimulus(const std::string& jsonParameters,
+                                       const brion::uint32_ts& cells);
 
     /**
      * Attach multiple stimulus generators to a list of cells.
@@ -73,14 +139,108 @@ public:
      * Each of the stimulus sources is connected to a different cell at the
      * moment they are received by the simulator.
      *
-     * This operation may fail silently in the current implementation.
-     *
+     * @return the acknowledgement of the request.
      * @throw std::runtime_error if an error is detected in generator
      * parameters
      * @version 0.2
      */
-    void injectMultipleStimuli(const std::string& jsonParameters,
-                               const brion::uint32_ts& cells);
+    std::future<double> injectMultipleStimuli(const std::string& jsonParameters,
+                                              const brion::uint32_ts& cells);
+
+    /**
+     * Attach a stimulus generator with typed parameters to a list of cells.
+     *
+     * Same as the JSON version, but the numeric parameters are sent in
+     * binary form and do not need to be parsed by the simulator. If the
+     * parameters have an onset time (StimulusParameters::setTime()), the
+     * stimulus starts exactly at that simulation time instead of when it is
+     * received.
+     *
+     * @return the acknowledgement of the request.
+     * @version 0.8
+     */
+    std::future<double> injectStimulus(const StimulusParameters& parameters,
+                                       const brion::uint32_ts& cells);
+
+    /**
+     * Attach multiple stimulus generators with typed parameters to a list of
+     * cells.
+     *
+     * @sa injectStimulus(const StimulusParameters&, const brion::uint32_ts&)
+     * @return the acknowledgement of the request.
+     * @version 0.8
+     */
+    std::future<double> injectMultipleStimuli(
+        const StimulusParameters& parameters, const brion::uint32_ts& cells);
+
+    /**
+     * Attach a stimulus generator to a list of cells and return a handle to
+     * change or remove it later.
+     *
+     * @sa injectStimulus(const StimulusParameters&, const brion::uint32_ts&)
+     * @version 0.8
+     */
+    StimulusHandle createStimulus(const StimulusParameters& parameters,
+                                  const brion::uint32_ts& cells);
+
+    /**
+     * Attach one stimulus generator per cell and return a handle to change
+     * or remove them later.
+     *
+     * @sa injectMultipleStimuli(const StimulusParameters&,
+     *                           const brion::uint32_ts&)
+     * @version 0.8
+     */
+    StimulusHandle createMultipleStimuli(const StimulusParameters& parameters,
+                                         const brion::uint32_ts& cells);
+
+    /**
+     * Register stimulus parameters once to reference them in later
+     * injections with StimulusParameters::setTemplate().
+     *
+     * The simulator keeps the parsed parameters of the template, so the
+     * injections only carry the parameters that differ. The onset time of
+     * the parameters is ignored.
+     *
+     * @return the template, whose id is valid immediately.
+     * @version 0.8
+     */
+    StimulusTemplate registerTemplate(const StimulusParameters& parameters);
+
+    /**
+     * Change the parameters of a stimulus.
+     *
+     * The simulator changes the existing generators instead of creating new
+     * ones. Only the parameters given are changed, the model and the onset
+     * time of the parameters are ignored.
+     *
+     * @return the acknowledgement of the request.
+     * @version 0.8
+     */
+    std::future<double> updateStimulus(const StimulusHandle& stimulus,
+                                       const StimulusParameters& parameters);
+
+    /**
+     * Stop a stimulus.
+     *
+     * The generators are silenced and may be reused by later stimuli of the
+     * same model on the same cells.
+     *
+     * @return the acknowledgement of the request.
+     * @version 0.8
+     */
+    std::future<double> removeStimulus(const StimulusHandle& stimulus);
+
+    /**
+     * Send a batch of stimulus injections as a single request.
+     *
+     * All the injections of the batch are applied at the same simulation
+     * step.
+     *
+     * @return the acknowledgement of the request.
+     * @version 0.8
+     */
+    std::future<double> submit(const StimulusBatch& batch);
 
     /**
      * Resumes/plays the simulation.
@@ -93,23 +253,75 @@ public:
      *
      * Does not check the current playback state of the simulation.
      *
+     * @return the acknowledgement of the request.
      * @version 0.2
-     *
      */
-    void play();
+    std::future<double> play();
 
     /**
      * Pauses the simulation.
      *
      * Does not check the current playback state of the simulation.
      *
+     * @return the acknowledgement of the request.
      * @version 0.2
+     */
+    std::future<double> pause();
+
+    /**
+     * Advances the simulation a number of simulator steps and pauses it.
+     *
+     * For NEST simulations a step is one tick of the MUSIC proxy, whose
+     * duration in simulation time is given by its --timestep option.
+     * A step count of 0 pauses the simulation.
+     *
+     * @return the acknowledgement of the request.
+     * @version 0.8
+     */
+    std::future<double> step(uint32_t count);
+
+    /**
+     * Runs the simulation until the given simulation timestamp and pauses it.
+     *
+     * The simulation is paused at the first simulator step that reaches
+     * the timestamp. It is paused immediately if the timestamp is already
+     * past.
+     *
+     * @param timestamp simulation time in milliseconds.
+     * @return the acknowledgement of the request.
+     * @version 0.8
+     */
+    std::future<double> runUntil(double timestamp);
+
+    /**
+     * Query the status of the simulation.
+     *
+     * The status is served by the simulator side from cached state, so the
+     * query does not interfere with the simulation. Querying the playback
+     * state avoids sending redundant play() and pause() requests.
+     *
+     * @return the status, ready when the reply is received.
+     * @version 0.8
+     */
+    std::future<SimulationStatus> getStatus();
+
+    /**
+     * A file descriptor that becomes readable when the future of a request
+     * or status query may have become ready, to wait for replies from an
+     * event loop without a thread per request.
      *
+     * The descriptor is shared by the simulators of the same endpoint. The
+     * watcher reads it until it would block, then checks its futures.
+     *
+     * @return the descriptor, or -1 if the plugin does not provide one.
+     * @version 0.8
      */
-    void pause();
+    int getReplyDescriptor() const;
 
 private:
     class Impl;
     Impl* _impl;
 };
 }
+
+#endif
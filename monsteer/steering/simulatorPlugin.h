@@ -23,6 +23,8 @@
 
 #include <boost/noncopyable.hpp>
 
+#include <future>
+
 namespace monsteer
 {
 /** Init data for SimulatorPlugin
@@ -54,18 +56,62 @@ public:
 
     virtual ~SimulatorPlugin() {}
     /** @copydoc Simulator::injectStimulus */
-    virtual void injectStimulus(const std::string& jsonParameters,
-                                const brion::uint32_ts& cells) = 0;
+    virtual std::future<double> injectStimulus(
+        const std::string& jsonParameters, const brion::uint32_ts& cells) = 0;
 
     /** @copydoc Simulator::injectMultipleStimuli */
-    virtual void injectMultipleStimuli(const std::string& jsonParameters,
-                                       const brion::uint32_ts& cells) = 0;
+    virtual std::future<double> injectMultipleStimuli(
+        const std::string& jsonParameters, const brion::uint32_ts& cells) = 0;
+
+    /** Typed parameters version of Simulator::injectStimulus. */
+    virtual std::future<double> injectStimulus(
+        const StimulusParameters& parameters,
+        const brion::uint32_ts& cells) = 0;
+
+    /** Typed parameters version of Simulator::injectMultipleStimuli. */
+    virtual std::future<double> injectMultipleStimuli(
+        const StimulusParameters& parameters,
+        const brion::uint32_ts& cells) = 0;
+
+    /**
+     * Attach stimulus generators to a list of cells with a handle.
+     * @sa Simulator::createStimulus, Simulator::createMultipleStimuli
+     */
+    virtual StimulusHandle createStimulus(const StimulusParameters& parameters,
+                                          const brion::uint32_ts& cells,
+                                          bool multiple) = 0;
+
+    /** @copydoc Simulator::registerTemplate */
+    virtual StimulusTemplate registerTemplate(
+        const StimulusParameters& parameters) = 0;
+
+    /** @copydoc Simulator::updateStimulus */
+    virtual std::future<double> updateStimulus(
+        uint64_t stimulusID, const StimulusParameters& parameters) = 0;
+
+    /** @copydoc Simulator::removeStimulus */
+    virtual std::future<double> removeStimulus(uint64_t stimulusID) = 0;
+
+    /** @copydoc Simulator::submit */
+    virtual std::future<double> submit(const StimulusBatch& batch) = 0;
 
     /** @copydoc Simulator::play */
-    virtual void play() = 0;
+    virtual std::future<double> play() = 0;
 
     /** @copydoc Simulator::pause */
-    virtual void pause() = 0;
+    virtual std::future<double> pause() = 0;
+
+    /** @copydoc Simulator::step */
+    virtual std::future<double> step(uint32_t count) = 0;
+
+    /** @copydoc Simulator::runUntil */
+    virtual std::future<double> runUntil(double timestamp) = 0;
+
+    /** @copydoc Simulator::getStatus */
+    virtual std::future<SimulationStatus> getStatus() = 0;
+
+    /** @copydoc Simulator::getReplyDescriptor */
+    virtual int getReplyDescriptor() const { return -1; }
 };
 }
 
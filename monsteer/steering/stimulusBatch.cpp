@@ -0,0 +1,109 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stimulusBatch.h"
+#include "cellSet.h"
+#include "simulator.h"
+#include "stimulusParameters.h"
+
+namespace monsteer
+{
+namespace
+{
+steering::CompactStimulusInjectionRecord _createRecord(
+    const std::string& jsonParameters)
+{
+    steering::CompactStimulusInjectionRecord record;
+    record.templateID = 0;
+    record.jsonParameters = jsonParameters;
+    record.time = 0;
+    return record;
+}
+
+steering::CompactStimulusInjectionRecord _createRecord(
+    const StimulusParameters& parameters)
+{
+    steering::CompactStimulusInjectionRecord record;
+    record.templateID = parameters.getTemplate();
+    record.model = parameters.getModel();
+    record.parameterNames = parameters.getJoinedNames();
+    record.parameterValues = parameters.getValues();
+    record.jsonParameters = parameters.getJSON();
+    record.time = parameters.getTime();
+    return record;
+}
+}
+
+void StimulusBatch::injectStimulus(const std::string& jsonParameters,
+                                   const brion::uint32_ts& cells)
+{
+    auto record = _createRecord(jsonParameters);
+    _add(record, cells, false);
+}
+
+void StimulusBatch::injectMultipleStimuli(const std::string& jsonParameters,
+                                          const brion::uint32_ts& cells)
+{
+    auto record = _createRecord(jsonParameters);
+    _add(record, cells, true);
+}
+
+void StimulusBatch::injectStimulus(const StimulusParameters& parameters,
+                                   const brion::uint32_ts& cells)
+{
+    auto record = _createRecord(parameters);
+    _add(record, cells, false);
+}
+
+void StimulusBatch::injectMultipleStimuli(const StimulusParameters& parameters,
+                                          const brion::uint32_ts& cells)
+{
+    auto record = _createRecord(parameters);
+    _add(record, cells, true);
+}
+
+void StimulusBatch::updateStimulus(const StimulusHandle& stimulus,
+                                   const StimulusParameters& parameters)
+{
+    steering::StimulusUpdateRecord record;
+    record.stimulusID = stimulus.id;
+    record.parameterNames = parameters.getJoinedNames();
+    record.parameterValues = parameters.getValues();
+    record.jsonParameters = parameters.getJSON();
+    _message.addStimulusUpdate(record);
+}
+
+void StimulusBatch::removeStimulus(const StimulusHandle& stimulus)
+{
+    _message.addStimulusRemoval(stimulus.id);
+}
+
+void StimulusBatch::_add(steering::CompactStimulusInjectionRecord& record,
+                         const brion::uint32_ts& cells, const bool multiple)
+{
+    brion::uint32_ts encoded;
+    // The batch is acknowledged as a whole.
+    record.messageID = 0;
+    record.multiple = multiple;
+    record.cellEncoding =
+        steering::encodeCells(cells.data(), cells.size(), encoded);
+    record.cells = encoded.data();
+    record.cellWords = encoded.size();
+    _message.addStimulusInjection(record);
+}
+}
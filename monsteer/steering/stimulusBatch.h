@@ -0,0 +1,80 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_STIMULUSBATCH_H
+#define MONSTEER_STIMULUSBATCH_H
+
+#include <monsteer/steering/musicMessage.h>
+#include <monsteer/types.h>
+
+namespace monsteer
+{
+/**
+ * A set of stimulus injections, updates and removals applied atomically by
+ * the simulator.
+ *
+ * The requests are encoded when added, so submitting a batch with
+ * Simulator::submit() costs a single message regardless of the number of
+ * requests. All the requests of a batch are applied by the simulator at the
+ * same simulation step.
+ *
+ * @version 0.8
+ */
+class StimulusBatch
+{
+public:
+    /** @sa Simulator::injectStimulus */
+    void injectStimulus(const std::string& jsonParameters,
+                        const brion::uint32_ts& cells);
+
+    /** @sa Simulator::injectMultipleStimuli */
+    void injectMultipleStimuli(const std::string& jsonParameters,
+                               const brion::uint32_ts& cells);
+
+    /** @sa Simulator::injectStimulus */
+    void injectStimulus(const StimulusParameters& parameters,
+                        const brion::uint32_ts& cells);
+
+    /** @sa Simulator::injectMultipleStimuli */
+    void injectMultipleStimuli(const StimulusParameters& parameters,
+                               const brion::uint32_ts& cells);
+
+    /** @sa Simulator::updateStimulus */
+    void updateStimulus(const StimulusHandle& stimulus,
+                        const StimulusParameters& parameters);
+
+    /** @sa Simulator::removeStimulus */
+    void removeStimulus(const StimulusHandle& stimulus);
+
+    /** @return the number of requests in the batch. */
+    size_t getSize() const { return _message.getRecordCount(); }
+    /** @return true if the batch has no requests. */
+    bool empty() const { return _message.empty(); }
+    /** Remove all the requests. */
+    void clear() { _message.clear(); }
+    /** @return the requests encoded as a steering message. */
+    const steering::MusicMessageWriter& getMessage() const { return _message; }
+private:
+    steering::MusicMessageWriter _message;
+
+    void _add(steering::CompactStimulusInjectionRecord& record,
+              const brion::uint32_ts& cells, bool multiple);
+};
+}
+
+#endif
@@ -0,0 +1,65 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "stimulusParameters.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace monsteer
+{
+StimulusParameters::StimulusParameters(const std::string& model)
+    : _model(model)
+{
+}
+
+void StimulusParameters::set(const std::string& name, const double value)
+{
+    if (name.find(';') != std::string::npos)
+        throw std::runtime_error("Invalid stimulus parameter name: " + name);
+
+    const auto i = std::find(_names.begin(), _names.end(), name);
+    if (i != _names.end())
+    {
+        _values[i - _names.begin()] = value;
+        return;
+    }
+    _names.push_back(name);
+    _values.push_back(value);
+}
+
+double StimulusParameters::get(const std::string& name) const
+{
+    const auto i = std::find(_names.begin(), _names.end(), name);
+    if (i == _names.end())
+        throw std::runtime_error("Unknown stimulus parameter: " + name);
+    return _values[i - _names.begin()];
+}
+
+std::string StimulusParameters::getJoinedNames() const
+{
+    std::string joined;
+    for (const auto& name : _names)
+    {
+        if (!joined.empty())
+            joined += ';';
+        joined += name;
+    }
+    return joined;
+}
+}
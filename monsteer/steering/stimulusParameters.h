@@ -0,0 +1,95 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef MONSTEER_STIMULUSPARAMETERS_H
+#define MONSTEER_STIMULUSPARAMETERS_H
+
+#include <monsteer/types.h>
+
+#include <string>
+#include <vector>
+
+namespace monsteer
+{
+/**
+ * Typed parameters of a stimulus generator.
+ *
+ * Numeric parameters are sent in binary form and do not need to be parsed
+ * by the simulator. Parameters of other types (e.g. arrays of spike times)
+ * can be given as a JSON object.
+ *
+ * @version 0.8
+ */
+class StimulusParameters
+{
+public:
+    /** @param model the name of the generator model in the simulator. */
+    explicit StimulusParameters(const std::string& model);
+
+    /** @return the name of the generator model. */
+    const std::string& getModel() const { return _model; }
+    /** Set a numeric parameter, replacing its previous value. */
+    void set(const std::string& name, double value);
+
+    /**
+     * @return the value of a numeric parameter.
+     * @throw std::runtime_error if the parameter is not set.
+     */
+    double get(const std::string& name) const;
+
+    /** @return the names of the numeric parameters in insertion order. */
+    const Strings& getNames() const { return _names; }
+    /** @return the names of the numeric parameters separated by ';'. */
+    std::string getJoinedNames() const;
+    /** @return the values of the numeric parameters in insertion order. */
+    const std::vector<double>& getValues() const { return _values; }
+    /** Set the non numeric parameters as a JSON object. */
+    void setJSON(const std::string& json) { _json = json; }
+    /** @return the non numeric parameters as a JSON object. */
+    const std::string& getJSON() const { return _json; }
+    /**
+     * Set the simulation time in milliseconds at which the stimulus starts.
+     *
+     * By default (0) the stimulus is applied as soon as it is received by
+     * the simulator. With an onset time the simulator applies it exactly at
+     * that time, provided the request arrives earlier, regardless of the
+     * network and MUSIC latency.
+     */
+    void setTime(const double timestamp) { _time = timestamp; }
+    /** @return the onset time of the stimulus in milliseconds. */
+    double getTime() const { return _time; }
+    /**
+     * Base the parameters on a template registered with
+     * Simulator::registerTemplate(). Only the parameters set here are sent
+     * with the injection, they override those of the template. The model
+     * may be left empty to use the one of the template.
+     */
+    void setTemplate(const uint64_t templateID) { _template = templateID; }
+    /** @return the template of the parameters, 0 if none. */
+    uint64_t getTemplate() const { return _template; }
+private:
+    std::string _model;
+    Strings _names;
+    std::vector<double> _values;
+    std::string _json;
+    double _time = 0;
+    uint64_t _template = 0;
+};
+}
+
+#endif
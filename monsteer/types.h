@@ -31,7 +31,13 @@ namespace monsteer
 using brion::Strings;
 using brion::URI;
 
+class Controller;
 class Simulator;
+class StimulusBatch;
+struct SimulationStatus;
+struct StimulusHandle;
+struct StimulusTemplate;
+class StimulusParameters;
 typedef boost::shared_ptr<Simulator> SimulatorPtr;
 }
 
@@ -0,0 +1,88 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <monsteer/steering/cellSet.h>
+
+#define BOOST_TEST_MODULE CellSet
+#include <boost/test/unit_test.hpp>
+
+using monsteer::steering::CellEncoding;
+
+namespace
+{
+CellEncoding _checkRoundTrip(const brion::uint32_ts& cells,
+                             const size_t maxWords)
+{
+    brion::uint32_ts encoded;
+    const CellEncoding encoding =
+        monsteer::steering::encodeCells(cells.data(), cells.size(), encoded);
+    BOOST_CHECK_LE(encoded.size(), maxWords);
+
+    const brion::uint32_ts decoded = monsteer::steering::decodeCells(
+        encoding, encoded.data(), encoded.size());
+    BOOST_CHECK_EQUAL_COLLECTIONS(decoded.begin(), decoded.end(),
+                                  cells.begin(), cells.end());
+    return encoding;
+}
+}
+
+BOOST_AUTO_TEST_CASE(test_unsorted_list)
+{
+    const brion::uint32_ts cells = {3, 7, 12, 20, 24, 30, 28, 1, 1};
+    BOOST_CHECK(_checkRoundTrip(cells, cells.size()) == CellEncoding::LIST);
+    BOOST_CHECK(_checkRoundTrip({}, 0) == CellEncoding::LIST);
+}
+
+BOOST_AUTO_TEST_CASE(test_contiguous_block)
+{
+    brion::uint32_ts cells;
+    for (uint32_t i = 0; i != 500000; ++i)
+        cells.push_back(1000 + i);
+    BOOST_CHECK(_checkRoundTrip(cells, 3) == CellEncoding::RANGES);
+}
+
+BOOST_AUTO_TEST_CASE(test_strided_blocks)
+{
+    brion::uint32_ts cells;
+    for (uint32_t i = 0; i != 1000; ++i)
+        cells.push_back(10 + i * 7);
+    for (uint32_t i = 0; i != 1000; ++i)
+        cells.push_back(100000 + i);
+    BOOST_CHECK(_checkRoundTrip(cells, 6) == CellEncoding::RANGES);
+}
+
+BOOST_AUTO_TEST_CASE(test_dense_random_subset)
+{
+    brion::uint32_ts cells;
+    for (uint32_t i = 0; i != 100000; ++i)
+        if ((i * 2654435761u) % 3 != 0)
+            cells.push_back(i + 1);
+    BOOST_CHECK(_checkRoundTrip(cells, 1 + 100000 / 32 + 1) ==
+                CellEncoding::BITMAP);
+}
+
+BOOST_AUTO_TEST_CASE(test_malformed)
+{
+    const uint32_t data[] = {1, 2};
+    BOOST_CHECK_THROW(monsteer::steering::decodeCells(CellEncoding::RANGES,
+                                                      data, 2),
+                      std::runtime_error);
+    BOOST_CHECK_THROW(monsteer::steering::decodeCells(CellEncoding::BITMAP,
+                                                      data, 0),
+                      std::runtime_error);
+}
@@ -0,0 +1,83 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <monsteer/histogram.h>
+
+#define BOOST_TEST_MODULE Histogram
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_CASE(test_empty)
+{
+    const monsteer::Histogram histogram;
+    BOOST_CHECK_EQUAL(histogram.getCount(), 0);
+    BOOST_CHECK_EQUAL(histogram.getMin(), 0);
+    BOOST_CHECK_EQUAL(histogram.getMax(), 0);
+    BOOST_CHECK_EQUAL(histogram.getMean(), 0);
+    BOOST_CHECK_EQUAL(histogram.getPercentile(50), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_small_values_are_exact)
+{
+    monsteer::Histogram histogram;
+    for (uint64_t i = 1; i <= 100; ++i)
+        histogram.record(i);
+
+    BOOST_CHECK_EQUAL(histogram.getCount(), 100);
+    BOOST_CHECK_EQUAL(histogram.getMin(), 1);
+    BOOST_CHECK_EQUAL(histogram.getMax(), 100);
+    BOOST_CHECK_EQUAL(histogram.getMean(), 50.5);
+    BOOST_CHECK_EQUAL(histogram.getPercentile(50), 50);
+    BOOST_CHECK_EQUAL(histogram.getPercentile(99), 99);
+    BOOST_CHECK_EQUAL(histogram.getPercentile(100), 100);
+}
+
+BOOST_AUTO_TEST_CASE(test_large_values_relative_error)
+{
+    monsteer::Histogram histogram;
+    for (uint64_t i = 1; i <= 100000; ++i)
+        histogram.record(i * 1000);
+
+    for (const double percentile : {10., 50., 90., 99., 99.9})
+    {
+        const double expected = percentile * 1000 * 1000;
+        BOOST_CHECK_CLOSE(double(histogram.getPercentile(percentile)),
+                          expected, 1.6);
+    }
+    BOOST_CHECK_EQUAL(histogram.getMax(), 100000000);
+    BOOST_CHECK_EQUAL(histogram.getPercentile(100), 100000000);
+}
+
+BOOST_AUTO_TEST_CASE(test_merge_and_reset)
+{
+    monsteer::Histogram first;
+    monsteer::Histogram second;
+    first.record(10, 3);
+    second.record(5);
+    second.record(1000000);
+
+    first.merge(second);
+    BOOST_CHECK_EQUAL(first.getCount(), 5);
+    BOOST_CHECK_EQUAL(first.getMin(), 5);
+    BOOST_CHECK_EQUAL(first.getMax(), 1000000);
+    BOOST_CHECK_EQUAL(first.getPercentile(50), 10);
+
+    first.reset();
+    BOOST_CHECK_EQUAL(first.getCount(), 0);
+    first.record(7);
+    BOOST_CHECK_EQUAL(first.getMin(), 7);
+}
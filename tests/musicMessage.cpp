@@ -0,0 +1,239 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <monsteer/steering/musicMessage.h>
+#include <monsteer/steering/stimulusBatch.h>
+#include <monsteer/steering/stimulusParameters.h>
+
+#define BOOST_TEST_MODULE MusicMessage
+#include <boost/test/unit_test.hpp>
+
+using monsteer::steering::MusicMessageReader;
+using monsteer::steering::MusicMessageRecord;
+using monsteer::steering::MusicMessageWriter;
+
+const uint32_t cellIds[] = {3, 7, 12, 20, 24, 30, 28, 1};
+const std::string jsonParameters("{\"model\": [\"poisson_generator\"]}");
+
+BOOST_AUTO_TEST_CASE(test_empty_message)
+{
+    MusicMessageWriter writer;
+    BOOST_CHECK(writer.empty());
+
+    MusicMessageReader reader(writer.toBase64());
+    BOOST_CHECK_EQUAL(reader.getRecordCount(), 0);
+    BOOST_CHECK(!reader.next());
+}
+
+BOOST_AUTO_TEST_CASE(test_stimulus_injections)
+{
+    MusicMessageWriter writer;
+    writer.addStimulusInjection(jsonParameters, cellIds, 8, false);
+    writer.addStimulusInjection("{}", cellIds + 2, 3, true);
+    BOOST_CHECK_EQUAL(writer.getRecordCount(), 2);
+
+    for (const auto& reader :
+         {MusicMessageReader(writer.toBase64()),
+          MusicMessageReader(writer.getData(), writer.getSize())})
+    {
+        MusicMessageReader copy(reader);
+        BOOST_CHECK_EQUAL(copy.getRecordCount(), 2);
+
+        BOOST_REQUIRE(copy.next());
+        BOOST_CHECK(copy.getType() == MusicMessageRecord::stimulusInjection);
+        auto record = copy.getStimulusInjection();
+        BOOST_CHECK_EQUAL(record.jsonParameters, jsonParameters);
+        BOOST_CHECK(!record.multiple);
+        BOOST_CHECK_EQUAL_COLLECTIONS(record.cells,
+                                      record.cells + record.cellCount,
+                                      cellIds, cellIds + 8);
+
+        BOOST_REQUIRE(copy.next());
+        record = copy.getStimulusInjection();
+        BOOST_CHECK_EQUAL(record.jsonParameters, "{}");
+        BOOST_CHECK(record.multiple);
+        BOOST_CHECK_EQUAL_COLLECTIONS(record.cells,
+                                      record.cells + record.cellCount,
+                                      cellIds + 2, cellIds + 5);
+
+        BOOST_CHECK(!copy.next());
+    }
+
+    writer.clear();
+    BOOST_CHECK(writer.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_timing)
+{
+    MusicMessageWriter writer;
+    writer.addStimulusInjection(jsonParameters, cellIds, 8, false);
+    writer.addTiming(1.5, 2.25, 120.0);
+
+    MusicMessageReader reader(writer.toBase64());
+    BOOST_REQUIRE(reader.next());
+    BOOST_REQUIRE(reader.next());
+    BOOST_CHECK(reader.getType() == MusicMessageRecord::timing);
+    BOOST_CHECK_THROW(reader.getStimulusInjection(), std::runtime_error);
+
+    const auto timing = reader.getTiming();
+    BOOST_CHECK_EQUAL(timing.receiveTime, 1.5);
+    BOOST_CHECK_EQUAL(timing.sendTime, 2.25);
+    BOOST_CHECK_EQUAL(timing.simulationTime, 120.0);
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_stimulus_injection)
+{
+    const uint32_t ranges[] = {1000, 500000, 1};
+
+    monsteer::steering::CompactStimulusInjectionRecord in;
+    in.messageID = 0x123456789ull;
+    in.templateID = 0x200000001ull;
+    in.model = "poisson_generator";
+    in.parameterNames = "rate;weight";
+    in.parameterValues = {50.0, 2.5};
+    in.time = 1250.5;
+    in.multiple = true;
+    in.cellEncoding = monsteer::steering::CellEncoding::RANGES;
+    in.cells = ranges;
+    in.cellWords = 3;
+
+    MusicMessageWriter writer;
+    writer.addStimulusInjection(in);
+    BOOST_CHECK_LT(writer.getSize(), 256);
+
+    MusicMessageReader reader(writer.toBase64());
+    BOOST_REQUIRE(reader.next());
+    BOOST_CHECK(reader.getType() ==
+                MusicMessageRecord::compactStimulusInjection);
+    BOOST_CHECK_THROW(reader.getStimulusInjection(), std::runtime_error);
+
+    const auto out = reader.getCompactStimulusInjection();
+    BOOST_CHECK_EQUAL(out.messageID, in.messageID);
+    BOOST_CHECK_EQUAL(out.templateID, in.templateID);
+    BOOST_CHECK_EQUAL(out.model, in.model);
+    BOOST_CHECK_EQUAL(out.parameterNames, in.parameterNames);
+    BOOST_CHECK_EQUAL_COLLECTIONS(out.parameterValues.begin(),
+                                  out.parameterValues.end(),
+                                  in.parameterValues.begin(),
+                                  in.parameterValues.end());
+    BOOST_CHECK(out.jsonParameters.empty());
+    BOOST_CHECK_EQUAL(out.time, in.time);
+    BOOST_CHECK(out.multiple);
+    BOOST_CHECK(out.cellEncoding == in.cellEncoding);
+    BOOST_CHECK_EQUAL_COLLECTIONS(out.cells, out.cells + out.cellWords,
+                                  ranges, ranges + 3);
+}
+
+BOOST_AUTO_TEST_CASE(test_stimulus_update_and_removal)
+{
+    const monsteer::steering::StimulusUpdateRecord in{0x100000002ull,
+                                                      "rate;start",
+                                                      {20.0, 5.0},
+                                                      "{}"};
+    MusicMessageWriter writer;
+    writer.addStimulusUpdate(in);
+    writer.addStimulusRemoval(in.stimulusID);
+
+    MusicMessageReader reader(writer.toBase64());
+    BOOST_REQUIRE(reader.next());
+    BOOST_CHECK(reader.getType() == MusicMessageRecord::stimulusUpdate);
+    BOOST_CHECK_THROW(reader.getStimulusRemoval(), std::runtime_error);
+    const auto out = reader.getStimulusUpdate();
+    BOOST_CHECK_EQUAL(out.stimulusID, in.stimulusID);
+    BOOST_CHECK_EQUAL(out.parameterNames, in.parameterNames);
+    BOOST_CHECK_EQUAL_COLLECTIONS(out.parameterValues.begin(),
+                                  out.parameterValues.end(),
+                                  in.parameterValues.begin(),
+                                  in.parameterValues.end());
+    BOOST_CHECK_EQUAL(out.jsonParameters, in.jsonParameters);
+
+    BOOST_REQUIRE(reader.next());
+    BOOST_CHECK(reader.getType() == MusicMessageRecord::stimulusRemoval);
+    BOOST_CHECK_EQUAL(reader.getStimulusRemoval(), in.stimulusID);
+    BOOST_CHECK(!reader.next());
+}
+
+BOOST_AUTO_TEST_CASE(test_stimulus_template)
+{
+    const monsteer::steering::StimulusTemplateRecord in{
+        0x300000004ull, "poisson_generator", "rate;start", {20.0, 5.0},
+        "{\"spike_times\": [1.0, 2.0]}"};
+    MusicMessageWriter writer;
+    writer.addStimulusTemplate(in);
+
+    MusicMessageReader reader(writer.toBase64());
+    BOOST_REQUIRE(reader.next());
+    BOOST_CHECK(reader.getType() == MusicMessageRecord::stimulusTemplate);
+    BOOST_CHECK_THROW(reader.getStimulusUpdate(), std::runtime_error);
+    const auto out = reader.getStimulusTemplate();
+    BOOST_CHECK_EQUAL(out.templateID, in.templateID);
+    BOOST_CHECK_EQUAL(out.model, in.model);
+    BOOST_CHECK_EQUAL(out.parameterNames, in.parameterNames);
+    BOOST_CHECK_EQUAL_COLLECTIONS(out.parameterValues.begin(),
+                                  out.parameterValues.end(),
+                                  in.parameterValues.begin(),
+                                  in.parameterValues.end());
+    BOOST_CHECK_EQUAL(out.jsonParameters, in.jsonParameters);
+    BOOST_CHECK(!reader.next());
+}
+
+BOOST_AUTO_TEST_CASE(test_add_records)
+{
+    monsteer::StimulusBatch batch;
+    monsteer::StimulusParameters parameters("poisson_generator");
+    parameters.set("rate", 100.0);
+    parameters.setTime(500.0);
+    parameters.setTemplate(42);
+    batch.injectStimulus(parameters, brion::uint32_ts(cellIds, cellIds + 8));
+    batch.injectMultipleStimuli(jsonParameters,
+                                brion::uint32_ts(cellIds, cellIds + 3));
+
+    MusicMessageWriter writer;
+    writer.addStimulusInjection(jsonParameters, cellIds, 8, false);
+    writer.addRecords(batch.getMessage().getData(),
+                      batch.getMessage().getSize());
+    BOOST_CHECK_EQUAL(writer.getRecordCount(), 3);
+    BOOST_CHECK_THROW(writer.addRecords(writer.getData(), 6),
+                      std::runtime_error);
+    BOOST_CHECK_EQUAL(writer.getRecordCount(), 3);
+
+    MusicMessageReader reader(writer.toBase64());
+    BOOST_REQUIRE(reader.next());
+    BOOST_CHECK(reader.getType() == MusicMessageRecord::stimulusInjection);
+    BOOST_REQUIRE(reader.next());
+    auto record = reader.getCompactStimulusInjection();
+    BOOST_CHECK_EQUAL(record.model, "poisson_generator");
+    BOOST_CHECK_EQUAL(record.parameterNames, "rate");
+    BOOST_CHECK_EQUAL(record.time, 500.0);
+    BOOST_CHECK_EQUAL(record.templateID, 42);
+    BOOST_CHECK(!record.multiple);
+    BOOST_REQUIRE(reader.next());
+    record = reader.getCompactStimulusInjection();
+    BOOST_CHECK_EQUAL(record.jsonParameters, jsonParameters);
+    BOOST_CHECK_EQUAL(record.time, 0.0);
+    BOOST_CHECK_EQUAL(record.templateID, 0);
+    BOOST_CHECK(record.multiple);
+    BOOST_CHECK(!reader.next());
+}
+
+BOOST_AUTO_TEST_CASE(test_invalid_message)
+{
+    BOOST_CHECK_THROW(MusicMessageReader("{\"eventType\": \"\"}"),
+                      std::runtime_error);
+    BOOST_CHECK_THROW(MusicMessageReader("AAAA"), std::runtime_error);
+}
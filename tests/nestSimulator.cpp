@@ -0,0 +1,407 @@
+/* Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+ *
+ * This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License version 3.0 as published
+ * by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <monsteer/steering/cellSet.h>
+#include <monsteer/steering/ensemble.h>
+#include <monsteer/steering/musicMessage.h>
+#include <monsteer/steering/playbackState.h>
+#include <monsteer/steering/reply.h>
+#include <monsteer/steering/simulator.h>
+#include <monsteer/steering/stimulus.h>
+#include <monsteer/steering/stimulusBatch.h>
+#include <monsteer/steering/stimulusParameters.h>
+#include <monsteer/types.h>
+
+#include <zeroeq/zeroeq.h>
+
+#define BOOST_TEST_MODULE NESTSimulator
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <poll.h>
+#include <unistd.h>
+
+namespace steering = monsteer::steering;
+
+// Stand-in for the music_proxy of one simulation of an ensemble. It
+// acknowledges all the requests it receives and records their cells and
+// stimulus updates.
+class Proxy
+{
+public:
+    explicit Proxy(const uint32_t index)
+        : _index(index)
+        , _running(true)
+    {
+        _subscribe(steering::StimulusInjectionV2::ZEROBUF_TYPE_IDENTIFIER(),
+                   [this](const void* data, const size_t size) {
+                       _onInjection(
+                           steering::StimulusInjectionV2::create(data, size));
+                   });
+        _subscribe(steering::StimulusUpdate::ZEROBUF_TYPE_IDENTIFIER(),
+                   [this](const void* data, const size_t size) {
+                       _onUpdate(steering::StimulusUpdate::create(data, size));
+                   });
+        _subscribe(steering::InjectionBatch::ZEROBUF_TYPE_IDENTIFIER(),
+                   [this](const void* data, const size_t size) {
+                       _onBatch(steering::InjectionBatch::create(data, size));
+                   });
+        _subscribe(steering::StatusRequest::ZEROBUF_TYPE_IDENTIFIER(),
+                   [this](const void* data, const size_t size) {
+                       const auto request =
+                           steering::StatusRequest::create(data, size);
+                       _publisher.publish(steering::StatusReply(
+                           request->getMessageID(), 0, steering::State::PAUSE,
+                           1, 0));
+                   });
+        _subscriber.subscribe(
+            steering::EnsembleRequest::ZEROBUF_TYPE_IDENTIFIER(),
+            [this](const void* data, const size_t size) {
+                _onEnsembleRequest(
+                    steering::EnsembleRequest::create(data, size));
+            });
+        _thread = std::thread([this] {
+            while (_running)
+                _subscriber.receive(10);
+        });
+    }
+
+    ~Proxy()
+    {
+        _running = false;
+        _thread.join();
+    }
+
+    brion::uint32_ts getCells() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _cells;
+    }
+
+    size_t getUpdates() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _updates;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cells.clear();
+        _updates = 0;
+    }
+
+private:
+    const uint32_t _index;
+    zeroeq::Subscriber _subscriber;
+    zeroeq::Publisher _publisher;
+    std::map<servus::uint128_t, zeroeq::EventPayloadFunc> _handlers;
+
+    mutable std::mutex _mutex;
+    brion::uint32_ts _cells;
+    size_t _updates = 0;
+
+    std::atomic<bool> _running;
+    std::thread _thread;
+
+    void _subscribe(const servus::uint128_t& type,
+                    const zeroeq::EventPayloadFunc& handler)
+    {
+        _subscriber.subscribe(type, handler);
+        _handlers[type] = handler;
+    }
+
+    void _onEnsembleRequest(steering::ConstEnsembleRequestPtr event)
+    {
+        if (event->getSimulation() != _index &&
+            event->getSimulation() != std::numeric_limits<uint32_t>::max())
+        {
+            return;
+        }
+        const servus::uint128_t type(event->getTypeHigh(),
+                                     event->getTypeLow());
+        const auto i = _handlers.find(type);
+        if (i == _handlers.end())
+            return;
+        const auto& data = event->getEvent();
+        i->second(data.data(), data.size());
+    }
+
+    void _onInjection(steering::ConstStimulusInjectionV2Ptr event)
+    {
+        const auto& cells = event->getCells();
+        _addCells(steering::decodeCells(event->getCellEncoding(),
+                                        cells.data(), cells.size()));
+        _acknowledge(event->getMessageID());
+    }
+
+    void _onUpdate(steering::ConstStimulusUpdatePtr event)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            ++_updates;
+        }
+        _acknowledge(event->getMessageID());
+    }
+
+    void _onBatch(steering::ConstInjectionBatchPtr event)
+    {
+        const auto& records = event->getRecords();
+        steering::MusicMessageReader reader(records.data(), records.size());
+        while (reader.next())
+        {
+            switch (reader.getType())
+            {
+            case steering::MusicMessageRecord::compactStimulusInjection:
+            {
+                const auto record = reader.getCompactStimulusInjection();
+                _addCells(steering::decodeCells(record.cellEncoding,
+                                                record.cells,
+                                                record.cellWords));
+                break;
+            }
+            case steering::MusicMessageRecord::stimulusUpdate:
+            case steering::MusicMessageRecord::stimulusRemoval:
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                ++_updates;
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        _acknowledge(event->getMessageID());
+    }
+
+    void _addCells(const brion::uint32_ts& cells)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cells.insert(_cells.end(), cells.begin(), cells.end());
+    }
+
+    void _acknowledge(const uint64_t messageID)
+    {
+        _publisher.publish(steering::Acknowledgement(
+            std::vector<uint64_t>(1, messageID), 0.0));
+    }
+};
+
+brion::uint32_ts range(const uint32_t first, const uint32_t last)
+{
+    brion::uint32_ts cells;
+    for (uint32_t cell = first; cell <= last; ++cell)
+        cells.push_back(cell);
+    return cells;
+}
+
+monsteer::StimulusParameters createParameters()
+{
+    monsteer::StimulusParameters parameters("dc_generator");
+    parameters.set("amplitude", 10.0);
+    return parameters;
+}
+
+BOOST_AUTO_TEST_CASE(test_invalid_ensemble_uri)
+{
+    for (const char* uri :
+         {"nest://?cells=1-10,20-5", "nest://?cells=1-10,a-b",
+          "nest://?cells=1-10,11", "nest://?simulations=0",
+          "nest://?simulations=two", "nest://?cells=1-10,11-20&simulations=3",
+          "nest://?timeout=soon"})
+    {
+        BOOST_CHECK_THROW(monsteer::Simulator(monsteer::URI(uri)),
+                          std::runtime_error);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_ensemble_size)
+{
+    Proxy first(0), second(1);
+    {
+        monsteer::Simulator simulator(monsteer::URI("nest://?simulations=2"));
+        BOOST_CHECK_EQUAL(simulator.getStatus().get().cellCount, 2);
+    }
+    {
+        monsteer::Simulator simulator(
+            monsteer::URI("nest://?cells=1-10,11-20&simulations=2"));
+        BOOST_CHECK_EQUAL(simulator.getStatus().get().cellCount, 2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_broadcast_ensemble)
+{
+    Proxy first(0), second(1);
+    monsteer::Simulator simulator(monsteer::URI("nest://?simulations=2"));
+    const auto cells = range(1, 20);
+
+    simulator.injectStimulus(createParameters(), cells).get();
+    BOOST_CHECK(first.getCells() == cells);
+    BOOST_CHECK(second.getCells() == cells);
+
+    first.clear();
+    second.clear();
+    monsteer::StimulusBatch batch;
+    batch.injectStimulus(createParameters(), cells);
+    simulator.submit(batch).get();
+    BOOST_CHECK(first.getCells() == cells);
+    BOOST_CHECK(second.getCells() == cells);
+}
+
+BOOST_AUTO_TEST_CASE(test_routed_ensemble)
+{
+    Proxy first(0), second(1);
+    monsteer::Simulator simulator(
+        monsteer::URI("nest://?cells=1-10,11-20"));
+
+    simulator.injectStimulus(createParameters(), range(5, 15)).get();
+    BOOST_CHECK(first.getCells() == range(5, 10));
+    BOOST_CHECK(second.getCells() == range(11, 15));
+    BOOST_CHECK_THROW(simulator.injectStimulus(createParameters(),
+                                               range(15, 25)),
+                      std::runtime_error);
+
+    // Updates only reach the simulations of the stimulus.
+    first.clear();
+    second.clear();
+    auto stimulus = simulator.createStimulus(createParameters(), range(1, 3));
+    stimulus.created.get();
+    simulator.updateStimulus(stimulus, createParameters()).get();
+    BOOST_CHECK(first.getCells() == range(1, 3));
+    BOOST_CHECK(second.getCells().empty());
+    BOOST_CHECK_EQUAL(first.getUpdates(), 1);
+    BOOST_CHECK_EQUAL(second.getUpdates(), 0);
+
+    // The records of a batch are routed the same way.
+    first.clear();
+    second.clear();
+    monsteer::StimulusBatch batch;
+    batch.injectStimulus(createParameters(), range(8, 12));
+    batch.injectStimulus(createParameters(), range(18, 20));
+    batch.removeStimulus(stimulus);
+    simulator.submit(batch).get();
+    BOOST_CHECK(first.getCells() == range(8, 10));
+    BOOST_CHECK(second.getCells() == brion::uint32_ts({11, 12, 18, 19, 20}));
+    BOOST_CHECK_EQUAL(first.getUpdates(), 1);
+    BOOST_CHECK_EQUAL(second.getUpdates(), 0);
+
+    batch.clear();
+    batch.injectStimulus(createParameters(), range(20, 21));
+    BOOST_CHECK_THROW(simulator.submit(batch), std::runtime_error);
+}
+
+bool isReadable(const int descriptor, const int timeout)
+{
+    pollfd watched{descriptor, POLLIN, 0};
+    return ::poll(&watched, 1, timeout) == 1;
+}
+
+void drain(const int descriptor)
+{
+    char buffer[64];
+    while (::read(descriptor, buffer, sizeof(buffer)) > 0)
+        ;
+}
+
+BOOST_AUTO_TEST_CASE(test_reply_descriptor)
+{
+    Proxy proxy(0);
+    monsteer::Simulator simulator(monsteer::URI("nest://"));
+    const int descriptor = simulator.getReplyDescriptor();
+    BOOST_REQUIRE(descriptor >= 0);
+    simulator.getStatus().get();
+    drain(descriptor);
+    BOOST_CHECK(!isReadable(descriptor, 0));
+
+    // Readable once the acknowledgement has been received.
+    auto injected = simulator.injectStimulus(createParameters(), range(1, 5));
+    BOOST_CHECK(isReadable(descriptor, 5000));
+    drain(descriptor);
+    BOOST_CHECK(injected.wait_for(std::chrono::seconds(0)) ==
+                std::future_status::ready);
+    BOOST_CHECK(!isReadable(descriptor, 0));
+}
+
+BOOST_AUTO_TEST_CASE(test_simulator_lifetime)
+{
+    // The connection outlives the simulators, so a simulator per request
+    // does not reconnect every time.
+    Proxy proxy(0);
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i != 50; ++i)
+    {
+        monsteer::Simulator simulator(monsteer::URI("nest://"));
+        simulator.injectStimulus(createParameters(), range(1, 5)).get();
+    }
+    BOOST_CHECK(std::chrono::steady_clock::now() - start <
+                std::chrono::seconds(2));
+
+    // The requests of a destroyed simulator are still acknowledged.
+    std::future<double> injected;
+    {
+        monsteer::Simulator simulator(monsteer::URI("nest://"));
+        injected = simulator.injectStimulus(createParameters(), range(1, 5));
+    }
+    BOOST_REQUIRE(injected.wait_for(std::chrono::seconds(5)) ==
+                  std::future_status::ready);
+    BOOST_CHECK_NO_THROW(injected.get());
+}
+
+BOOST_AUTO_TEST_CASE(test_slow_joiner)
+{
+    // The requests made before the proxies are started are queued, not
+    // lost. The connection is kept from the previous tests, which started
+    // fewer proxies, so it waits for all of them.
+    monsteer::Simulator simulator(monsteer::URI("nest://?simulations=3"));
+    auto injected = simulator.injectStimulus(createParameters(), range(1, 5));
+    auto status = simulator.getStatus();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    Proxy first(0), second(1), third(2);
+    BOOST_CHECK_NO_THROW(injected.get());
+    BOOST_CHECK_EQUAL(status.get().cellCount, 3);
+    BOOST_CHECK(third.getCells() == range(1, 5));
+}
+
+BOOST_AUTO_TEST_CASE(test_timeout)
+{
+    // More proxies than ever started, so the connection is not established.
+    monsteer::Simulator simulator(
+        monsteer::URI("nest://?simulations=1000&timeout=100"));
+    auto injected = simulator.injectStimulus(createParameters(), range(1, 5));
+    auto status = simulator.getStatus();
+    BOOST_CHECK_THROW(injected.get(), std::runtime_error);
+    BOOST_CHECK_THROW(status.get(), std::runtime_error);
+
+    // The queue of requests waiting for a proxy is bounded.
+    size_t queued = 0;
+    try
+    {
+        for (; queued != 100000; ++queued)
+            simulator.injectStimulus(createParameters(), range(1, 5));
+    }
+    catch (const std::runtime_error&)
+    {
+    }
+    BOOST_CHECK_LT(queued, 100000);
+}
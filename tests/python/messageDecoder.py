@@ -0,0 +1,162 @@
+#!/usr/bin/env python
+
+## Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+##
+## This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+
+# Checks that monsteer.MessageDecoder (C++) and the Python decoder of Nesteer
+# return the same requests, with the same types, for the steering messages
+# encoded by monsteer.StimulusBatch. The records that a batch cannot contain
+# are appended following the layout of monsteer/steering/musicMessage.h.
+# NEST is replaced by a module that only provides GetDefaults.
+
+import base64
+import struct
+import sys
+import types
+import unittest
+
+import numpy
+
+import monsteer
+
+_DEFAULTS = {'poisson_generator': {'rate': 0.0, 'start': 0.0, 'n': 1,
+                                   'spike_times': []}}
+
+
+class NESTError(Exception):
+    pass
+
+
+def _get_defaults(model):
+    if model not in _DEFAULTS:
+        raise NESTError('Unknown model ' + model)
+    return _DEFAULTS[model]
+
+nest = types.ModuleType('nest')
+nest.GetDefaults = _get_defaults
+nest.pynestkernel = types.ModuleType('pynestkernel')
+nest.pynestkernel.NESTError = NESTError
+sys.modules['nest'] = nest
+
+from monsteer import Nesteer
+
+
+def _pad(data):
+    return data + b'\0' * (-len(data) % 4)
+
+
+def _record(record_type, payload):
+    return struct.pack('=2I', record_type, len(payload)) + payload
+
+
+def _template(template_id, model, names, values, json_params=''):
+    model, names = model.encode(), names.encode()
+    json_params = json_params.encode()
+    return _record(6, struct.pack('=6I', template_id & 0xffffffff,
+                                  template_id >> 32, len(model), len(names),
+                                  len(values), len(json_params)) +
+                   _pad(model) + _pad(names) + _pad(json_params) +
+                   struct.pack('={0}d'.format(len(values)), *values))
+
+
+def _update(stimulus_id, names, values, json_params=''):
+    names, json_params = names.encode(), json_params.encode()
+    return _record(4, struct.pack('=5I', stimulus_id & 0xffffffff,
+                                  stimulus_id >> 32, len(names), len(values),
+                                  len(json_params)) +
+                   _pad(names) + _pad(json_params) +
+                   struct.pack('={0}d'.format(len(values)), *values))
+
+
+def _removal(stimulus_id):
+    return _record(5, struct.pack('=2I', stimulus_id & 0xffffffff,
+                                  stimulus_id >> 32))
+
+
+def _append(message, records):
+    """ Appends encoded records to a base64 steering message. """
+    data = base64.b64decode(message)
+    magic, version, count, reserved = struct.unpack_from('=4I', data)
+    header = struct.pack('=4I', magic, version, count + len(records),
+                         reserved)
+    return base64.b64encode(header + data[16:] + b''.join(records)).decode()
+
+
+def _normalize(value):
+    """ Returns value with the type of each leaf, ints and longs match. """
+    if isinstance(value, numpy.ndarray):
+        return ('array', str(value.dtype), value.tolist())
+    if isinstance(value, (list, tuple)):
+        return [_normalize(item) for item in value]
+    if isinstance(value, dict):
+        return dict((key, _normalize(item)) for key, item in value.items())
+    name = type(value).__name__
+    return ('int' if name == 'long' else name, value)
+
+
+@unittest.skipUnless(hasattr(monsteer, 'MessageDecoder'),
+                     'monsteer built without NumPy')
+class MessageDecoderTest(unittest.TestCase):
+    def _decode(self, messages):
+        ours = monsteer.MessageDecoder(_get_defaults).decode(messages)
+        theirs = Nesteer._MessageDecoder(_get_defaults).decode(messages)
+        self.assertEqual(_normalize(ours), _normalize(theirs))
+        return ours
+
+    def test_compact_injections(self):
+        batch = monsteer.StimulusBatch()
+        # Integer defaults are coerced, n is sent as a double
+        parameters = monsteer.StimulusParameters(
+            {'model': 'poisson_generator', 'rate': 5.0, 'n': 2.7,
+             'spike_times': [1.0, 2.0]})
+        batch.injectStimulus(parameters, numpy.array([3, 1, 2], 'u4'))
+        scheduled = monsteer.StimulusParameters(
+            {'model': 'poisson_generator', 'start': 1.0})
+        scheduled.setTime(12.5)
+        batch.injectMultipleStimuli(scheduled, numpy.arange(10, 5000, 7))
+        unknown = monsteer.StimulusParameters({'model': 'unknown', 'n': 2.0})
+        batch.injectStimulus(unknown, [1, 5, 6, 7, 8, 9, 30])
+
+        requests, timings = self._decode([batch.toBase64()])
+        self.assertEqual(len(requests), 3)
+        self.assertEqual(timings, [])
+        self.assertEqual(type(requests[0][2]['n']), int)
+        self.assertEqual(type(requests[0][2]['rate']), float)
+        self.assertEqual(requests[0][2]['spike_times'], [1.0, 2.0])
+        self.assertEqual(requests[0][3].tolist(), [3, 1, 2])
+        self.assertEqual(requests[1][4], True)
+        self.assertEqual(requests[1][5], 12.5)
+        self.assertEqual(requests[1][3].tolist(), list(range(10, 5000, 7)))
+        self.assertEqual(type(requests[2][2]['n']), float)
+
+    def test_template_update_removal(self):
+        batch = monsteer.StimulusBatch()
+        overrides = monsteer.StimulusParameters('')
+        overrides.set('n', 4.2)
+        overrides.setTemplate(7)
+        batch.injectStimulus(overrides, [4, 5])
+        message = batch.toBase64()
+        template = monsteer.StimulusBatch().toBase64()
+        template = _append(template, [_template(7, 'poisson_generator',
+                                                'rate;n', [3.0, 2.0])])
+        message = _append(message, [_update(2 << 40, 'rate;n', [1.0, 2.0],
+                                            '{"spike_times": [1.0]}'),
+                                    _removal(2 << 40)])
+
+        requests, timings = self._decode([template, message])
+        kinds = [request[0] for request in requests]
+        self.assertEqual(kinds, [Nesteer._TEMPLATE, Nesteer._INJECT,
+                                 Nesteer._UPDATE, Nesteer._REMOVE])
+        self.assertEqual(type(requests[0][2]['n']), int)
+        # The parameters of the injection take the types of the template
+        self.assertEqual(requests[1][6], 7)
+        self.assertEqual(requests[1][2], {'n': 4})
+        # Only Nesteer knows the model of an updated stimulus
+        self.assertEqual(requests[2][1], 2 << 40)
+        self.assertEqual(type(requests[2][2]['n']), float)
+        self.assertEqual(requests[3], (Nesteer._REMOVE, 2 << 40))
+
+
+if __name__ == '__main__':
+    unittest.main()
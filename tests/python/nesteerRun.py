@@ -0,0 +1,125 @@
+#!/usr/bin/env python
+
+## Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+##
+## This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+
+# Checks the chunks that Nesteer.run() passes to nest.Simulate: they grow
+# while no steering message arrives, up to the bound given by the latency
+# target, and shrink again when one arrives. NEST is replaced by a module
+# that records the Simulate calls and delivers steering messages on demand.
+
+import sys
+import types
+import unittest
+
+import numpy
+
+import monsteer
+
+
+class NESTError(Exception):
+    pass
+
+
+class _Kernel(object):
+    def __init__(self):
+        self.time = 0.0
+        self.chunks = []
+        self.messages = []
+        # Messages to deliver at the end of the next chunks
+        self.arriving = []
+
+    def simulate(self, duration):
+        self.chunks.append(round(duration, 6))
+        self.time += duration
+        if self.arriving:
+            self.messages.extend(self.arriving.pop(0))
+
+    def get_status(self, nodes, key=None):
+        if key == 'global_id':
+            return tuple(nodes)
+        if key == 'data':
+            return [{'messages': list(self.messages)}]
+        return [{} for node in nodes]
+
+    def set_status(self, nodes, params):
+        if isinstance(params, dict) and 'n_messages' in params:
+            self.messages = []
+
+
+_kernel = _Kernel()
+_ids = iter(range(1000, 1 << 30))
+
+nest = types.ModuleType('nest')
+nest.pynestkernel = types.ModuleType('pynestkernel')
+nest.pynestkernel.NESTError = NESTError
+nest.sli_run = lambda command: None
+nest.spp = lambda: True
+nest.Create = lambda model, count=1: tuple(next(_ids) for i in range(count))
+nest.Connect = lambda *args, **kwargs: None
+nest.GetDefaults = lambda model: {'rate': 0.0, 'origin': 0.0,
+                                  'start': 0.0, 'stop': 1e9}
+nest.GetStatus = _kernel.get_status
+nest.SetStatus = _kernel.set_status
+nest.GetKernelStatus = lambda key: 0.1 if key == 'resolution' \
+                                   else _kernel.time
+nest.Simulate = _kernel.simulate
+sys.modules['nest'] = nest
+
+from monsteer import Nesteer
+
+
+def _message():
+    batch = monsteer.StimulusBatch()
+    batch.injectStimulus(
+        monsteer.StimulusParameters({'model': 'poisson_generator',
+                                     'rate': 5.0}),
+        numpy.array([1], dtype=numpy.uint32))
+    return batch.toBase64()
+
+
+class TestRun(unittest.TestCase):
+    def setUp(self):
+        _kernel.__init__()
+        self.steering = Nesteer.Nesteer('spikes', 'steering', [1, 2],
+                                        [1, 2], target_latency=40.0)
+        # Number of chunks simulated when each stimulus was injected
+        self.injected = []
+        self.steering.set_apply_generators_to_neurons_function(
+            lambda generators, neurons:
+                self.injected.append(len(_kernel.chunks)))
+
+    def test_latency_bound(self):
+        steering = self.steering
+        # MUSIC tick + acceptable latency + largest chunk
+        self.assertLessEqual(10.0 + 20.0 + steering.max_simulation_step,
+                             40.0)
+        self.assertLess(steering.simulation_step,
+                        steering.max_simulation_step)
+
+    def test_idle_chunks_grow(self):
+        self.steering.run(200.0)
+        chunks = _kernel.chunks
+        self.assertAlmostEqual(sum(chunks), 200.0)
+        self.assertEqual(chunks[0], self.steering.simulation_step)
+        self.assertEqual(max(chunks), self.steering.max_simulation_step)
+        # Fewer calls than with a fixed simulation_step
+        self.assertLess(len(chunks), 200.0 / self.steering.simulation_step)
+
+    def test_steering_shrinks_chunks(self):
+        step = self.steering.simulation_step
+        largest = self.steering.max_simulation_step
+        _kernel.arriving = [[], [], [_message()]]
+        self.steering.run(100.0)
+        self.assertEqual(_kernel.chunks[:5],
+                         [step, largest, largest, step, largest])
+        self.assertEqual(self.injected, [3])
+
+    def test_pending_messages_first(self):
+        _kernel.messages = [_message()]
+        self.steering.run(5.0)
+        self.assertEqual(self.injected, [0])
+
+if __name__ == '__main__':
+    unittest.main()
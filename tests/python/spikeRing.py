@@ -0,0 +1,150 @@
+#!/usr/bin/env python
+
+## Copyright (c) 2006-2017, Juan Hernando <jhernando@fi.upm.es>
+##
+## This file is part of Monsteer <https://github.com/BlueBrain/Monsteer>
+
+# Checks the batches read from a monsteer.spikeRing.SpikeRing: wrap-around at
+# the end of the spike buffer, detection of the batches overwritten before or
+# after being read and the end of the readers when the ring is closed.
+
+import shutil
+import tempfile
+import threading
+import unittest
+
+import numpy
+
+from monsteer.spikeRing import SPIKE_DTYPE, SpikeRing, SpikeRingReader
+
+
+def _spikes(first, count):
+    spikes = numpy.zeros(count, dtype=SPIKE_DTYPE)
+    spikes['gid'] = numpy.arange(first, first + count)
+    spikes['time'] = spikes['gid'] * 0.5
+    return spikes
+
+
+class TestSpikeRing(unittest.TestCase):
+    def setUp(self):
+        self._directory = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self._directory)
+
+    def _ring(self, capacity, slots):
+        ring = SpikeRing(capacity=capacity, slots=slots,
+                         directory=self._directory)
+        return ring, SpikeRingReader(ring.path)
+
+    def test_read_batches(self):
+        ring, reader = self._ring(100, 8)
+        ring.write(_spikes(0, 10), 0.0, 10.0)
+        ring.write(_spikes(10, 0), 10.0, 20.0)
+        ring.write(_spikes(10, 5), 20.0, 30.0)
+
+        batch = reader.read()
+        self.assertEqual((batch.index, batch.start, batch.end), (0, 0.0, 10.0))
+        self.assertTrue(numpy.array_equal(batch.spikes, _spikes(0, 10)))
+        self.assertEqual(len(reader.read().spikes), 0)
+        batch = reader.read()
+        self.assertTrue(numpy.array_equal(batch.spikes, _spikes(10, 5)))
+        self.assertIsNone(reader.read(timeout=0))
+        self.assertEqual(reader.lost, 0)
+
+    def test_wrap_around(self):
+        ring, reader = self._ring(10, 8)
+        ring.write(_spikes(0, 4))
+        ring.write(_spikes(4, 4))
+        first = reader.read()
+        second = reader.read()
+        # Does not fit after the second batch, it is written at the start
+        ring.write(_spikes(8, 4))
+        third = reader.read()
+
+        self.assertTrue(numpy.array_equal(third.spikes, _spikes(8, 4)))
+        self.assertFalse(reader.valid(first))
+        self.assertTrue(reader.valid(second))
+        self.assertTrue(numpy.array_equal(second.spikes, _spikes(4, 4)))
+        self.assertTrue(reader.valid(third))
+
+        with self.assertRaises(ValueError):
+            ring.write(_spikes(0, 11))
+
+    def test_overwritten_spikes(self):
+        ring, reader = self._ring(10, 8)
+        ring.write(_spikes(0, 6))
+        batch = reader.read()
+        self.assertTrue(reader.valid(batch))
+        ring.write(_spikes(6, 6))
+        self.assertFalse(reader.valid(batch))
+
+        # Written and overwritten before being read
+        ring.write(_spikes(12, 6))
+        batch = reader.read()
+        self.assertEqual(batch.index, 2)
+        self.assertTrue(numpy.array_equal(batch.spikes, _spikes(12, 6)))
+        self.assertEqual(reader.lost, 1)
+
+    def test_overwritten_slots(self):
+        ring, reader = self._ring(100, 4)
+        for i in range(10):
+            ring.write(_spikes(i, 1))
+        batches = []
+        batch = reader.read(timeout=0)
+        while batch is not None:
+            self.assertTrue(reader.valid(batch))
+            batches.append(batch)
+            batch = reader.read(timeout=0)
+
+        # The oldest slot is the next one to be written, it is skipped
+        self.assertEqual([b.index for b in batches], [7, 8, 9])
+        self.assertEqual(reader.lost, 7)
+        self.assertEqual(batches[-1].spikes['gid'][0], 9)
+        ring.write(_spikes(10, 1))
+        self.assertFalse(reader.valid(batches[0]))
+        self.assertTrue(reader.valid(batches[1]))
+
+    def test_concurrent_writer(self):
+        ring, reader = self._ring(64, 4)
+
+        def write():
+            for i in range(2000):
+                spikes = _spikes(0, 1 + i % 16)
+                spikes['gid'] = i
+                ring.write(spikes, i, i + 1)
+            ring.close()
+        thread = threading.Thread(target=write)
+        thread.start()
+        count = 0
+        for batch in reader:
+            gids = batch.spikes['gid'].copy()
+            if reader.valid(batch):
+                self.assertEqual(batch.start, batch.index)
+                self.assertEqual(len(gids), 1 + batch.index % 16)
+                self.assertTrue((gids == batch.index).all())
+            count += 1
+        thread.join()
+        self.assertEqual(count + reader.lost, 2000)
+
+    def test_close(self):
+        ring, reader = self._ring(100, 8)
+        late = SpikeRingReader(ring.path)
+        batches = []
+        thread = threading.Thread(
+            target=lambda: batches.extend(b.index for b in reader))
+        thread.start()
+        ring.write(_spikes(0, 5))
+        ring.write(_spikes(5, 5))
+        ring.close()
+        thread.join(10)
+
+        self.assertFalse(thread.is_alive())
+        self.assertEqual(batches, [0, 1])
+        self.assertEqual([b.index for b in late], [0, 1])
+        self.assertIsNone(reader.read())
+        self.assertIsNone(SpikeRingReader(ring.path).read())
+
+
+if __name__ == '__main__':
+    unittest.main()
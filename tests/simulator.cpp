@@ -17,9 +17,15 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <brion/spikeReport.h>
 #include <lunchbox/pluginRegisterer.h>
+#include <lunchbox/sleep.h>
+#include <monsteer/plugin/spikeReport.h>
+#include <monsteer/steering/controller.h>
 #include <monsteer/steering/simulator.h>
 #include <monsteer/steering/simulatorPlugin.h>
+#include <monsteer/steering/stimulusBatch.h>
+#include <monsteer/steering/stimulusParameters.h>
 #include <monsteer/types.h>
 
 #define BOOST_TEST_MODULE Simulator
@@ -30,13 +36,28 @@ struct SimulatorData
     enum PlaybackState
     {
         PAUSE = 0u,
-        PLAY = 1u
+        PLAY = 1u,
+        STEP = 2u,
+        RUN_UNTIL = 3u
     };
 
     monsteer::URI subscriber;
     brion::uint32_ts cells;
     std::string stimulusString;
+    std::string stimulusModel;
+    double stimulusTime;
+    brion::Strings parameterNames;
+    std::vector<double> parameterValues;
+    bool multiple;
     PlaybackState playbackState;
+    uint32_t steps;
+    double untilTime;
+    size_t batchSize;
+    uint64_t stimulusID;
+    uint64_t templateID;
+    uint64_t registeredTemplates = 0;
+    bool removed;
+    double time = 0; // Simulation time of the next acknowledgement
 };
 
 SimulatorData globalData;
@@ -55,25 +76,143 @@ public:
     }
 
     static std::string getDescription() { return "dummy://"; }
-    void injectStimulus(const std::string& jsonParameters,
-                        const brion::uint32_ts& cells) final
+    std::future<double> injectStimulus(const std::string& jsonParameters,
+                                       const brion::uint32_ts& cells) final
     {
         globalData.stimulusString = jsonParameters;
         globalData.cells = cells;
+        return _acknowledge();
     }
 
-    void injectMultipleStimuli(const std::string& jsonParameters,
-                               const brion::uint32_ts& cells) final
+    std::future<double> injectMultipleStimuli(
+        const std::string& jsonParameters, const brion::uint32_ts& cells) final
     {
         globalData.stimulusString = jsonParameters;
         globalData.cells = cells;
+        return _acknowledge();
     }
 
-    void play() { globalData.playbackState = SimulatorData::PLAY; }
-    void pause() { globalData.playbackState = SimulatorData::PAUSE; }
+    std::future<double> injectStimulus(
+        const monsteer::StimulusParameters& parameters,
+        const brion::uint32_ts& cells) final
+    {
+        _setParameters(parameters, cells, false);
+        return _acknowledge();
+    }
+
+    std::future<double> injectMultipleStimuli(
+        const monsteer::StimulusParameters& parameters,
+        const brion::uint32_ts& cells) final
+    {
+        _setParameters(parameters, cells, true);
+        return _acknowledge();
+    }
+
+    monsteer::StimulusHandle createStimulus(
+        const monsteer::StimulusParameters& parameters,
+        const brion::uint32_ts& cells, const bool multiple) final
+    {
+        _setParameters(parameters, cells, multiple);
+        globalData.removed = false;
+        return monsteer::StimulusHandle{++globalData.stimulusID,
+                                        _acknowledge()};
+    }
+
+    monsteer::StimulusTemplate registerTemplate(
+        const monsteer::StimulusParameters& parameters) final
+    {
+        globalData.stimulusModel = parameters.getModel();
+        globalData.parameterNames = parameters.getNames();
+        globalData.parameterValues = parameters.getValues();
+        return monsteer::StimulusTemplate{++globalData.registeredTemplates,
+                                          _acknowledge()};
+    }
+
+    std::future<double> updateStimulus(
+        const uint64_t stimulusID,
+        const monsteer::StimulusParameters& parameters) final
+    {
+        BOOST_CHECK_EQUAL(stimulusID, globalData.stimulusID);
+        globalData.parameterNames = parameters.getNames();
+        globalData.parameterValues = parameters.getValues();
+        return _acknowledge();
+    }
+
+    std::future<double> removeStimulus(const uint64_t stimulusID) final
+    {
+        BOOST_CHECK_EQUAL(stimulusID, globalData.stimulusID);
+        globalData.removed = true;
+        return _acknowledge();
+    }
+
+    std::future<double> submit(const monsteer::StimulusBatch& batch) final
+    {
+        globalData.batchSize = batch.getSize();
+        return _acknowledge();
+    }
+
+    std::future<double> play()
+    {
+        globalData.playbackState = SimulatorData::PLAY;
+        return _acknowledge();
+    }
+
+    std::future<double> pause()
+    {
+        globalData.playbackState = SimulatorData::PAUSE;
+        return _acknowledge();
+    }
+
+    std::future<double> step(const uint32_t count)
+    {
+        globalData.playbackState = SimulatorData::STEP;
+        globalData.steps = count;
+        return _acknowledge();
+    }
+
+    std::future<double> runUntil(const double timestamp)
+    {
+        globalData.playbackState = SimulatorData::RUN_UNTIL;
+        globalData.untilTime = timestamp;
+        return _acknowledge();
+    }
+
+    std::future<monsteer::SimulationStatus> getStatus()
+    {
+        std::promise<monsteer::SimulationStatus> promise;
+        promise.set_value(monsteer::SimulationStatus{
+            globalData.time,
+            monsteer::steering::State(globalData.playbackState), 100,
+            globalData.removed ? 0u : 1u});
+        return promise.get_future();
+    }
+
+private:
+    // Requests are acknowledged immediately, one millisecond apart.
+    std::future<double> _acknowledge()
+    {
+        std::promise<double> promise;
+        promise.set_value(globalData.time);
+        globalData.time += 1;
+        return promise.get_future();
+    }
+
+    void _setParameters(const monsteer::StimulusParameters& parameters,
+                        const brion::uint32_ts& cells, const bool multiple)
+    {
+        globalData.stimulusModel = parameters.getModel();
+        globalData.parameterNames = parameters.getNames();
+        globalData.parameterValues = parameters.getValues();
+        globalData.stimulusString = parameters.getJSON();
+        globalData.stimulusTime = parameters.getTime();
+        globalData.templateID = parameters.getTemplate();
+        globalData.cells = cells;
+        globalData.multiple = multiple;
+    }
 };
 
 lunchbox::PluginRegisterer<DummySimulator> registerer;
+lunchbox::PluginRegisterer<monsteer::plugin::SpikeReport> spikesRegisterer;
 
 BOOST_AUTO_TEST_CASE(test_create_handled_simulator)
 {
@@ -133,6 +272,94 @@ BOOST_AUTO_TEST_CASE(test_inject_multiple_stimuli)
     globalData.cells.clear();
 }
 
+BOOST_AUTO_TEST_CASE(test_inject_typed_stimulus)
+{
+    monsteer::Simulator simulator(uri);
+
+    const brion::uint32_ts cells(cellIds, cellIds + 8);
+    monsteer::StimulusParameters parameters("poisson_generator");
+    parameters.set("rate", 100.0);
+    parameters.set("start", 5.0);
+    parameters.set("rate", 200.0);
+    BOOST_CHECK_EQUAL(parameters.get("rate"), 200.0);
+    BOOST_CHECK_THROW(parameters.get("stop"), std::runtime_error);
+    BOOST_CHECK_EQUAL(parameters.getTime(), 0);
+    parameters.setTime(1000);
+
+    simulator.injectMultipleStimuli(parameters, cells);
+    BOOST_CHECK_EQUAL(globalData.stimulusModel, "poisson_generator");
+    BOOST_CHECK_EQUAL(globalData.parameterNames.size(), 2);
+    BOOST_CHECK_EQUAL(globalData.parameterNames[0], "rate");
+    BOOST_CHECK_EQUAL(globalData.parameterValues[0], 200.0);
+    BOOST_CHECK_EQUAL(globalData.stimulusTime, 1000);
+    BOOST_CHECK_EQUAL(globalData.cells, cells);
+    BOOST_CHECK(globalData.multiple);
+
+    globalData.cells.clear();
+}
+
+BOOST_AUTO_TEST_CASE(test_update_remove_stimulus)
+{
+    monsteer::Simulator simulator(uri);
+
+    monsteer::StimulusParameters parameters("dc_generator");
+    parameters.set("amplitude", 10.0);
+    auto stimulus = simulator.createMultipleStimuli(
+        parameters, brion::uint32_ts(cellIds, cellIds + 8));
+    BOOST_CHECK(globalData.multiple);
+    BOOST_CHECK_NO_THROW(stimulus.created.get());
+
+    parameters.set("amplitude", 20.0);
+    simulator.updateStimulus(stimulus, parameters).get();
+    BOOST_CHECK_EQUAL(globalData.parameterValues[0], 20.0);
+
+    simulator.removeStimulus(stimulus).get();
+    BOOST_CHECK(globalData.removed);
+
+    globalData.cells.clear();
+}
+
+BOOST_AUTO_TEST_CASE(test_stimulus_template)
+{
+    monsteer::Simulator simulator(uri);
+
+    monsteer::StimulusParameters parameters("poisson_generator");
+    parameters.set("rate", 100.0);
+    parameters.set("start", 5.0);
+    auto stimulusTemplate = simulator.registerTemplate(parameters);
+    BOOST_CHECK_EQUAL(globalData.stimulusModel, "poisson_generator");
+    BOOST_CHECK_NO_THROW(stimulusTemplate.registered.get());
+
+    // Only the overridden parameters are sent with the injection.
+    monsteer::StimulusParameters overrides("");
+    overrides.setTemplate(stimulusTemplate.id);
+    overrides.set("rate", 200.0);
+    simulator.injectStimulus(overrides, brion::uint32_ts(cellIds, cellIds + 8));
+    BOOST_CHECK_EQUAL(globalData.templateID, stimulusTemplate.id);
+    BOOST_CHECK(globalData.stimulusModel.empty());
+    BOOST_CHECK_EQUAL(globalData.parameterValues.size(), 1);
+
+    globalData.cells.clear();
+}
+
+BOOST_AUTO_TEST_CASE(test_submit_batch)
+{
+    monsteer::Simulator simulator(uri);
+
+    monsteer::StimulusBatch batch;
+    monsteer::StimulusParameters parameters("poisson_generator");
+    parameters.set("rate", 100.0);
+    for (uint32_t i = 0; i != 8; ++i)
+        batch.injectStimulus(parameters, brion::uint32_ts(1, cellIds[i]));
+    batch.injectMultipleStimuli(jsonParameters,
+                                brion::uint32_ts(cellIds, cellIds + 8));
+    BOOST_CHECK_EQUAL(batch.getSize(), 9);
+
+    globalData.time = 10;
+    BOOST_CHECK_EQUAL(simulator.submit(batch).get(), 10);
+    BOOST_CHECK_EQUAL(globalData.batchSize, 9);
+}
+
 BOOST_AUTO_TEST_CASE(test_play_pause)
 {
     monsteer::Simulator simulator(uri);
@@ -143,3 +370,88 @@ BOOST_AUTO_TEST_CASE(test_play_pause)
     simulator.pause();
     BOOST_CHECK(globalData.playbackState == SimulatorData::PAUSE);
 }
+
+BOOST_AUTO_TEST_CASE(test_acknowledgements)
+{
+    monsteer::Simulator simulator(uri);
+    const brion::uint32_ts cells(cellIds, cellIds + 8);
+
+    globalData.time = 100;
+    std::vector<std::future<double>> acks;
+    for (size_t i = 0; i != 10; ++i)
+        acks.push_back(simulator.injectStimulus(jsonParameters, cells));
+    acks.push_back(simulator.play());
+
+    double expected = 100;
+    for (auto& ack : acks)
+        BOOST_CHECK_EQUAL(ack.get(), expected++);
+
+    globalData.cells.clear();
+}
+
+BOOST_AUTO_TEST_CASE(test_status)
+{
+    monsteer::Simulator simulator(uri);
+
+    simulator.pause();
+    const auto status = simulator.getStatus().get();
+    BOOST_CHECK_EQUAL(status.time, globalData.time);
+    BOOST_CHECK(status.state == monsteer::steering::State::PAUSE);
+    BOOST_CHECK_EQUAL(status.cellCount, 100);
+}
+
+BOOST_AUTO_TEST_CASE(test_step_run_until)
+{
+    monsteer::Simulator simulator(uri);
+
+    simulator.step(10);
+    BOOST_CHECK(globalData.playbackState == SimulatorData::STEP);
+    BOOST_CHECK_EQUAL(globalData.steps, 10);
+
+    simulator.runUntil(250.5);
+    BOOST_CHECK(globalData.playbackState == SimulatorData::RUN_UNTIL);
+    BOOST_CHECK_EQUAL(globalData.untilTime, 250.5);
+}
+
+BOOST_AUTO_TEST_CASE(test_closed_loop_controller)
+{
+    monsteer::Simulator simulator(uri);
+    brion::SpikeReport emitter(
+        brion::URI(MONSTEER_BRION_SPIKES_PLUGIN_SCHEME + "://127.0.0.1"),
+        brion::MODE_WRITE);
+
+    // Each window stimulates the cells that spiked in it. The latency of
+    // each window lasts until its stimulus is acknowledged.
+    size_t spikeCount = 0;
+    monsteer::Controller controller(
+        emitter.getURI(), simulator, 1.f,
+        [&](const brion::Spikes& spikes, const float start, const float end,
+            monsteer::Simulator& steered) {
+            BOOST_CHECK_LT(start, end);
+            brion::uint32_ts cells;
+            for (const auto& spike : spikes)
+            {
+                BOOST_CHECK(spike.first >= start && spike.first < end);
+                cells.push_back(spike.second);
+            }
+            spikeCount += spikes.size();
+            if (cells.empty())
+                return std::future<double>();
+            return steered.injectStimulus(jsonParameters, cells);
+        });
+    lunchbox::sleep(250); // ZeroEQ connection setup
+
+    controller.start();
+    BOOST_CHECK(controller.isRunning());
+    emitter.write({{0.1f, 20}, {0.2f, 22}});
+    emitter.write({{1.5f, 23}});
+    emitter.write({{2.5f, 24}});
+    emitter.close();
+    controller.wait();
+
+    BOOST_CHECK(!controller.isRunning());
+    BOOST_CHECK_EQUAL(spikeCount, 4);
+    BOOST_CHECK_EQUAL(controller.getWindowCount(), 3);
+    BOOST_CHECK_EQUAL(controller.getLatencies().getCount(), 3);
+    BOOST_CHECK(globalData.cells == brion::uint32_ts{24});
+}